@@ -0,0 +1,75 @@
+#include "Arena.h"
+
+#include <algorithm>
+#include <new>
+
+namespace {
+
+// Large buffers are at least this aligned, so overflow allocations can come straight from them
+const size_t largeBufferAlignment = 64;
+
+} // namespace
+
+ScratchArena::~ScratchArena() {
+    reset();
+    if (block) {
+        freeLargeBuffer(block, blockSize);
+    }
+}
+
+void ScratchArena::reset() {
+    for (const auto& allocation : overflow) {
+        freeLargeBuffer(allocation.first, allocation.second);
+    }
+    overflow.clear();
+
+    // Replace the block with one that would have held everything, so the next job of this size fits
+    if (peakBytes > blockSize) {
+        if (block) {
+            freeLargeBuffer(block, blockSize);
+        }
+        blockSize = peakBytes;
+        block = static_cast<unsigned char*>(allocateLargeBuffer(blockSize));
+    }
+
+    usedBytes = 0;
+    overflowBytes = 0;
+}
+
+// Grows the block now, so an allocation whose size is known up front fits without overflowing first;
+// like reset, only valid while nothing from the arena is still in use
+void ScratchArena::reserve(size_t bytes) {
+    peakBytes = std::max(peakBytes, bytes);
+    reset();
+}
+
+// Returns the block, for when holding on to it costs more than faulting in a new one later
+void ScratchArena::release() {
+    reset();
+    if (block) {
+        freeLargeBuffer(block, blockSize);
+    }
+    block = nullptr;
+    blockSize = 0;
+    peakBytes = 0;
+}
+
+void* ScratchArena::do_allocate(size_t bytes, size_t alignment) {
+    if (alignment > largeBufferAlignment) {
+        throw std::bad_alloc();
+    }
+
+    size_t offset = (usedBytes + alignment - 1) / alignment * alignment;
+    if (block && offset + bytes <= blockSize) {
+        usedBytes = offset + bytes;
+        peakBytes = std::max(peakBytes, usedBytes + overflowBytes);
+        return block + offset;
+    }
+
+    // Out of room until the next reset; counted with padding so the grown block is sure to hold it
+    void* allocation = allocateLargeBuffer(std::max<size_t>(bytes, 1));
+    overflow.emplace_back(allocation, std::max<size_t>(bytes, 1));
+    overflowBytes += bytes + alignment;
+    peakBytes = std::max(peakBytes, usedBytes + overflowBytes);
+    return allocation;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "SoundCanvas.h"
+
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+// Bump allocator for per-job scratch that is thrown away all at once. Memory is only returned by
+// reset(), which keeps the block for the next job and grows it to the high-water mark when the
+// last job did not fit, so a worker stops allocating once it has seen its largest job
+class ScratchArena : public std::pmr::memory_resource {
+public:
+    ScratchArena() = default;
+    ~ScratchArena() override;
+
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+
+    void reset();
+    void reserve(size_t bytes);
+    void release();
+    size_t capacity() const { return blockSize; }
+    size_t highWaterMark() const { return peakBytes; }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    unsigned char* block = nullptr;
+    size_t blockSize = 0;
+    size_t usedBytes = 0;
+    size_t overflowBytes = 0; // Served outside the block since the last reset
+    size_t peakBytes = 0;
+    std::vector<std::pair<void*, size_t>> overflow;
+};
@@ -0,0 +1,47 @@
+#include "AsyncRender.h"
+
+#include <algorithm>
+
+AsyncRender::AsyncRender(const cv::Mat& image, const cv::Mat& alphaChannel, const SynthesisSettings& settings, Executor executor, int rowsPerBlock)
+    : image(image), alphaChannel(alphaChannel), settings(settings), executor(std::move(executor)), rowsPerBlock(std::max(1, rowsPerBlock)) {
+}
+
+AsyncRender::NextBlock AsyncRender::next() {
+    return NextBlock(*this);
+}
+
+bool AsyncRender::finished() const {
+    return nextRow >= image.rows;
+}
+
+AudioBlock AsyncRender::renderNextBlock() {
+    int rowCount = std::min(rowsPerBlock, image.rows - nextRow);
+
+    AudioBlock block;
+    block.firstSample = static_cast<long long>(nextRow) * settings.samplesPerRow;
+    block.samples.resize(static_cast<size_t>(rowCount) * settings.samplesPerRow);
+
+    for (int row = nextRow; row < nextRow + rowCount; ++row) {
+        scratch.reset();
+        renderRows(image, alphaChannel, row, 1, settings, block.samples.data() + static_cast<size_t>(row - nextRow) * settings.samplesPerRow, &scratch);
+    }
+
+    nextRow += rowCount;
+    return block;
+}
+
+bool AsyncRender::NextBlock::await_ready() const noexcept {
+    // Nothing left to render, so there is no reason to leave the caller's thread
+    return render.finished();
+}
+
+void AsyncRender::NextBlock::await_suspend(std::coroutine_handle<> awaiting) {
+    render.executor([this, awaiting]() {
+        block = render.renderNextBlock();
+        awaiting.resume();
+    });
+}
+
+std::optional<AudioBlock> AsyncRender::NextBlock::await_resume() {
+    return std::move(block);
+}
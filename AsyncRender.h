@@ -0,0 +1,64 @@
+#pragma once
+
+#include "SoundCanvas.h"
+#include "Arena.h"
+
+#include <coroutine>
+#include <functional>
+#include <optional>
+
+// Consecutive rows of rendered audio; firstSample is the block's position on the untrimmed timeline
+struct AudioBlock {
+    long long firstSample = 0;
+    SampleBuffer samples;
+};
+
+// Render driven from a coroutine: each co_await next() renders one block of rows as a task on the
+// caller's executor and resumes the awaiting coroutine there once it is done, so an event loop can
+// interleave many renders without a blocked thread per render. The render must outlive any
+// outstanding next(), which holds when it lives in the awaiting coroutine's frame.
+//
+//     AsyncRender render(image, alphaChannel, settings, executor);
+//     while (std::optional<AudioBlock> block = co_await render.next()) {
+//         ...
+//     }
+class AsyncRender {
+public:
+    // Runs a task on some thread, now or later; for example posting to an event loop or pool
+    using Executor = std::function<void(std::function<void()>)>;
+
+    // Awaiter for the next block; empty once every row has been rendered
+    class NextBlock {
+    public:
+        explicit NextBlock(AsyncRender& render)
+            : render(render) {
+        }
+
+        bool await_ready() const noexcept;
+        void await_suspend(std::coroutine_handle<> awaiting);
+        std::optional<AudioBlock> await_resume();
+
+    private:
+        AsyncRender& render;
+        std::optional<AudioBlock> block;
+    };
+
+    AsyncRender(const cv::Mat& image, const cv::Mat& alphaChannel, const SynthesisSettings& settings, Executor executor, int rowsPerBlock = 16);
+
+    AsyncRender(const AsyncRender&) = delete;
+    AsyncRender& operator=(const AsyncRender&) = delete;
+
+    NextBlock next();
+    bool finished() const;
+
+private:
+    AudioBlock renderNextBlock();
+
+    cv::Mat image;
+    cv::Mat alphaChannel;
+    SynthesisSettings settings;
+    Executor executor;
+    int rowsPerBlock;
+    int nextRow = 0; // Only touched by the one block task in flight
+    ScratchArena scratch;
+};
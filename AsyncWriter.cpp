@@ -0,0 +1,347 @@
+#include "AsyncWriter.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+// liburing is optional; without it the I/O thread falls back to plain buffered writes
+#if defined(__linux__) && __has_include(<liburing.h>)
+#include <liburing.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#define SOUNDCANVAS_HAS_URING 1
+#else
+#define SOUNDCANVAS_HAS_URING 0
+#endif
+
+namespace {
+
+const size_t wavHeaderSize = 44;
+
+void putLittleEndian(unsigned char* destination, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        destination[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+// Canonical 16-bit PCM header with interleaved channels, the same layout libsndfile writes for our
+// output format; the length is known before the first byte goes out, so no header fix-up is needed
+void buildWavHeader(unsigned char* header, size_t samples, int channels, int sampleRate) {
+    uint32_t dataBytes = static_cast<uint32_t>(samples * sizeof(short));
+    uint32_t blockAlign = static_cast<uint32_t>(channels) * sizeof(short);
+    std::memcpy(header, "RIFF", 4);
+    putLittleEndian(header + 4, 36 + dataBytes, 4);
+    std::memcpy(header + 8, "WAVEfmt ", 8);
+    putLittleEndian(header + 16, 16, 4); // fmt chunk size
+    putLittleEndian(header + 20, 1, 2); // PCM
+    putLittleEndian(header + 22, static_cast<uint32_t>(channels), 2);
+    putLittleEndian(header + 24, static_cast<uint32_t>(sampleRate), 4);
+    putLittleEndian(header + 28, static_cast<uint32_t>(sampleRate) * blockAlign, 4); // Byte rate
+    putLittleEndian(header + 32, blockAlign, 2);
+    putLittleEndian(header + 34, 16, 2); // Bits per sample
+    std::memcpy(header + 36, "data", 4);
+    putLittleEndian(header + 40, dataBytes, 4);
+}
+
+// Audible range widened to whole frames, so trimming never splits the channels of one frame
+void findAudibleFrames(const SampleBuffer& samples, int channels, size_t& begin, size_t& end) {
+    findAudibleRange(samples.data(), samples.size(), begin, end);
+    size_t frameSamples = static_cast<size_t>(std::max(1, channels));
+    begin -= begin % frameSamples;
+    end = std::min(samples.size(), (end + frameSamples - 1) / frameSamples * frameSamples);
+}
+
+} // namespace
+
+#if SOUNDCANVAS_HAS_URING
+// Ring plus a pool of buffers registered with the kernel once, so writes skip the per-call page
+// pinning; samples are staged into a free buffer and written with a fixed-buffer write
+struct AsyncWavWriter::Ring {
+    static const unsigned bufferCount = 32;
+    static const size_t bufferBytes = 1024 * 1024;
+
+    // One output file with chunks still in flight
+    struct OpenFile {
+        Request request;
+        int descriptor = -1;
+        int chunksInFlight = 0;
+        bool allQueued = false;
+        bool failed = false;
+    };
+
+    io_uring ring;
+    std::vector<unsigned char> storage;
+    std::vector<unsigned> freeBuffers;
+    OpenFile* bufferOwner[bufferCount] = {};
+    size_t bufferLength[bufferCount] = {};
+
+    bool initialize() {
+        if (io_uring_queue_init(bufferCount, &ring, 0) != 0) {
+            return false;
+        }
+
+        storage.resize(bufferCount * bufferBytes);
+        std::vector<iovec> buffers(bufferCount);
+        for (unsigned i = 0; i < bufferCount; ++i) {
+            buffers[i].iov_base = storage.data() + i * bufferBytes;
+            buffers[i].iov_len = bufferBytes;
+            freeBuffers.push_back(i);
+        }
+
+        if (io_uring_register_buffers(&ring, buffers.data(), bufferCount) != 0) {
+            io_uring_queue_exit(&ring);
+            return false;
+        }
+        return true;
+    }
+
+    ~Ring() {
+        io_uring_queue_exit(&ring);
+    }
+};
+#else
+struct AsyncWavWriter::Ring {
+};
+#endif
+
+AsyncWavWriter::AsyncWavWriter(size_t maxQueuedBytes)
+    : maxQueuedBytes(maxQueuedBytes) {
+#if SOUNDCANVAS_HAS_URING
+    // Kernels without io_uring, or sandboxes that block it, get the plain writer instead
+    ring = std::make_unique<Ring>();
+    if (!ring->initialize()) {
+        ring.reset();
+    }
+#endif
+    ioThread = std::thread(&AsyncWavWriter::ioLoop, this);
+}
+
+AsyncWavWriter::~AsyncWavWriter() {
+    finish();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queueChanged.notify_all();
+    ioThread.join();
+}
+
+void AsyncWavWriter::write(const std::string& filePath, SampleBuffer samples, const SynthesisSettings& settings,
+    std::function<void(bool)> onComplete) {
+    size_t bytes = samples.size() * sizeof(short);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    // Push back on renders once the backlog is large, but always accept a request into an empty queue
+    queueChanged.wait(lock, [&]() { return queuedBytes == 0 || queuedBytes + bytes <= maxQueuedBytes; });
+
+    queuedBytes += bytes;
+    queue.push_back({ filePath, std::move(samples), settings, std::move(onComplete) });
+    queueChanged.notify_all();
+}
+
+void AsyncWavWriter::finish() {
+    std::unique_lock<std::mutex> lock(mutex);
+    queueChanged.wait(lock, [&]() { return queue.empty() && requestsInProgress == 0; });
+}
+
+const char* AsyncWavWriter::backendName() const {
+    return ring ? "io_uring" : "writer thread";
+}
+
+void AsyncWavWriter::completeRequest(Request& request, bool succeeded) {
+    if (!succeeded) {
+        std::cerr << "Error: Could not write output WAV file " << request.filePath << "." << std::endl;
+    }
+    if (request.onComplete) {
+        request.onComplete(succeeded);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requestsInProgress--;
+    }
+    queueChanged.notify_all();
+}
+
+void AsyncWavWriter::writeWithStdio(Request& request) {
+    size_t begin = 0;
+    size_t end = 0;
+    findAudibleFrames(request.samples, request.settings.channels, begin, end);
+
+    unsigned char header[wavHeaderSize];
+    buildWavHeader(header, end - begin, request.settings.channels, request.settings.sampleRate);
+
+    // Samples go out in host order, which is little-endian on every platform we build for
+    std::FILE* file = std::fopen(request.filePath.c_str(), "wb");
+    bool succeeded = file && std::fwrite(header, 1, wavHeaderSize, file) == wavHeaderSize
+        && std::fwrite(request.samples.data() + begin, sizeof(short), end - begin, file) == end - begin;
+    if (file && std::fclose(file) != 0) {
+        succeeded = false;
+    }
+
+    completeRequest(request, succeeded);
+}
+
+void AsyncWavWriter::ioLoop() {
+#if SOUNDCANVAS_HAS_URING
+    using OpenFile = Ring::OpenFile;
+    std::vector<std::unique_ptr<OpenFile>> openFiles;
+    int chunksInFlight = 0;
+
+    auto finishFile = [&](OpenFile* openFile) {
+        bool closed = close(openFile->descriptor) == 0;
+        bool succeeded = closed && !openFile->failed;
+        completeRequest(openFile->request, succeeded);
+        openFiles.erase(std::find_if(openFiles.begin(), openFiles.end(), [&](const auto& candidate) { return candidate.get() == openFile; }));
+    };
+
+    auto reapCompletion = [&](io_uring_cqe* completion) {
+        unsigned buffer = static_cast<unsigned>(reinterpret_cast<uintptr_t>(io_uring_cqe_get_data(completion)));
+        OpenFile* openFile = ring->bufferOwner[buffer];
+        if (completion->res < 0 || static_cast<size_t>(completion->res) != ring->bufferLength[buffer]) {
+            openFile->failed = true;
+        }
+        io_uring_cqe_seen(&ring->ring, completion);
+
+        ring->freeBuffers.push_back(buffer);
+        chunksInFlight--;
+        if (--openFile->chunksInFlight == 0 && openFile->allQueued) {
+            finishFile(openFile);
+        }
+    };
+
+    // Sleeps in the kernel until a write lands, then recycles the buffers of every write that has.
+    // Signals only interrupt the wait, so it is retried rather than spinning back through the loop;
+    // false on any other failure, after which the ring cannot be trusted to report completions
+    auto reapCompletions = [&]() {
+        io_uring_cqe* completion = nullptr;
+        int result = 0;
+        do {
+            io_uring_submit(&ring->ring);
+            result = io_uring_wait_cqe(&ring->ring, &completion);
+        } while (result == -EINTR || result == -EAGAIN);
+        if (result != 0) {
+            std::cerr << "Error: Waiting for output writes failed: " << std::strerror(-result) << "." << std::endl;
+            return false;
+        }
+
+        reapCompletion(completion);
+        while (io_uring_peek_cqe(&ring->ring, &completion) == 0) {
+            reapCompletion(completion);
+        }
+        return true;
+    };
+
+    // Files with writes in flight can no longer be confirmed, so they are reported failed and the
+    // ring is torn down; later requests take the plain writer
+    auto abandonRing = [&]() {
+        for (const auto& openFile : openFiles) {
+            close(openFile->descriptor);
+            completeRequest(openFile->request, false);
+        }
+        openFiles.clear();
+        chunksInFlight = 0;
+        ring.reset();
+    };
+#endif
+
+    while (true) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+#if SOUNDCANVAS_HAS_URING
+            // With nothing new to start, make progress on the writes already queued
+            if (queue.empty() && chunksInFlight > 0) {
+                lock.unlock();
+                if (!reapCompletions()) {
+                    abandonRing();
+                }
+                continue;
+            }
+#endif
+            queueChanged.wait(lock, [&]() { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+
+            request = std::move(queue.front());
+            queue.pop_front();
+            queuedBytes -= request.samples.size() * sizeof(short);
+            requestsInProgress++;
+        }
+        queueChanged.notify_all();
+
+        if (!ring) {
+            writeWithStdio(request);
+            continue;
+        }
+
+#if SOUNDCANVAS_HAS_URING
+        openFiles.push_back(std::make_unique<OpenFile>());
+        OpenFile* openFile = openFiles.back().get();
+        openFile->request = std::move(request);
+        openFile->descriptor = open(openFile->request.filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (openFile->descriptor < 0) {
+            completeRequest(openFile->request, false);
+            openFiles.pop_back();
+            continue;
+        }
+
+        const SampleBuffer& samples = openFile->request.samples;
+        size_t begin = 0;
+        size_t end = 0;
+        findAudibleFrames(samples, openFile->request.settings.channels, begin, end);
+
+        unsigned char header[wavHeaderSize];
+        buildWavHeader(header, end - begin, openFile->request.settings.channels, openFile->request.settings.sampleRate);
+
+        // The header and the trimmed samples are one byte stream cut into buffer-sized chunks
+        const unsigned char* sampleBytes = reinterpret_cast<const unsigned char*>(samples.data() + begin);
+        size_t totalBytes = wavHeaderSize + (end - begin) * sizeof(short);
+        for (size_t offset = 0; offset < totalBytes;) {
+            if (ring->freeBuffers.empty()) {
+                if (!reapCompletions()) {
+                    abandonRing();
+                    break;
+                }
+                continue;
+            }
+
+            unsigned buffer = ring->freeBuffers.back();
+            ring->freeBuffers.pop_back();
+            unsigned char* staging = ring->storage.data() + buffer * Ring::bufferBytes;
+            size_t length = std::min(Ring::bufferBytes, totalBytes - offset);
+
+            for (size_t copied = 0; copied < length;) {
+                size_t position = offset + copied;
+                size_t run = position < wavHeaderSize ? std::min(length - copied, wavHeaderSize - position) : length - copied;
+                const unsigned char* source = position < wavHeaderSize ? header + position : sampleBytes + (position - wavHeaderSize);
+                std::memcpy(staging + copied, source, run);
+                copied += run;
+            }
+
+            io_uring_sqe* submission = io_uring_get_sqe(&ring->ring);
+            io_uring_prep_write_fixed(submission, openFile->descriptor, staging, static_cast<unsigned>(length), offset, static_cast<int>(buffer));
+            io_uring_sqe_set_data(submission, reinterpret_cast<void*>(static_cast<uintptr_t>(buffer)));
+            ring->bufferOwner[buffer] = openFile;
+            ring->bufferLength[buffer] = length;
+            openFile->chunksInFlight++;
+            chunksInFlight++;
+            offset += length;
+        }
+
+        if (!ring) {
+            continue;
+        }
+
+        io_uring_submit(&ring->ring);
+        openFile->allQueued = true;
+        if (openFile->chunksInFlight == 0) {
+            finishFile(openFile);
+        }
+#endif
+    }
+}
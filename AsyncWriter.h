@@ -0,0 +1,52 @@
+#pragma once
+
+#include "SoundCanvas.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Writes finished renders as trimmed WAV files on a dedicated I/O thread, so render workers
+// hand their samples off and move on; uses io_uring with registered buffers where available
+class AsyncWavWriter {
+public:
+    explicit AsyncWavWriter(size_t maxQueuedBytes = 256 * 1024 * 1024);
+    ~AsyncWavWriter();
+
+    AsyncWavWriter(const AsyncWavWriter&) = delete;
+    AsyncWavWriter& operator=(const AsyncWavWriter&) = delete;
+
+    // Blocks only while more than maxQueuedBytes are waiting; onComplete runs on the I/O thread
+    void write(const std::string& filePath, SampleBuffer samples, const SynthesisSettings& settings,
+        std::function<void(bool)> onComplete = nullptr);
+    void finish();
+    const char* backendName() const;
+
+private:
+    struct Request {
+        std::string filePath;
+        SampleBuffer samples;
+        SynthesisSettings settings;
+        std::function<void(bool)> onComplete;
+    };
+
+    struct Ring; // io_uring state, defined only where liburing is available
+
+    void ioLoop();
+    void writeWithStdio(Request& request);
+    void completeRequest(Request& request, bool succeeded);
+
+    std::unique_ptr<Ring> ring; // Empty when writing falls back to plain file writes
+    std::mutex mutex;
+    std::condition_variable queueChanged;
+    std::deque<Request> queue;
+    size_t maxQueuedBytes;
+    size_t queuedBytes = 0;
+    size_t requestsInProgress = 0; // Taken off the queue but not completed yet
+    bool stopping = false;
+    std::thread ioThread;
+};
@@ -0,0 +1,345 @@
+#include "Batch.h"
+
+#include <iostream>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+// One batch input with the size known before decoding
+struct BatchInput {
+    std::string path;
+    cv::Size imageSize; // Empty when the header could not be probed
+    size_t fileSize = 0;
+    double headerCost = 0.0; // Upper bound assuming every pixel is audible, used for ordering
+    uint64_t fileHash = 0;
+    size_t duplicateOf = SIZE_MAX; // Index of the input whose output this one reuses
+
+    // Written by the worker that converts the input
+    bool converted = false;
+    double processingSeconds = 0.0;
+};
+
+// Gives a duplicate its own output name without rendering again, sharing the file when possible
+bool linkOutput(const std::string& originalPath, const std::string& duplicatePath) {
+    std::error_code error;
+    if (std::filesystem::equivalent(originalPath, duplicatePath, error)) {
+        return true;
+    }
+
+    error.clear();
+    std::filesystem::remove(duplicatePath, error);
+    std::filesystem::create_hard_link(originalPath, duplicatePath, error);
+    if (error) {
+        error.clear();
+        std::filesystem::copy_file(originalPath, duplicatePath, std::filesystem::copy_options::overwrite_existing, error);
+    }
+    return !error;
+}
+
+} // namespace
+
+// Renders are split into row blocks shared by all render workers, --jobs of them or one per core,
+// so one huge image cannot leave the others idle at the end of a batch
+ConversionContext::ConversionContext(const DecodeOptions& decodeOptions, const BatchOptions& batchOptions, bool deduplicate)
+    : decodeOptions(decodeOptions), batchOptions(batchOptions),
+      scheduler(batchOptions.jobs > 0 ? batchOptions.jobs : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()))),
+      budget(batchOptions.memoryBudget), deduplicate(deduplicate) {
+    if (batchOptions.asyncOutput) {
+        writer = std::make_unique<AsyncWavWriter>();
+    }
+}
+
+ConversionWorker::ConversionWorker(ConversionContext& context) : context(context) {
+}
+
+ConversionWorker::~ConversionWorker() {
+    context.budget.release(arenaCharge);
+}
+
+ConversionOutcome convertStillImage(ConversionWorker& worker, size_t id, const std::string& inputPath, const std::string& outputPath,
+    std::function<void(bool)> onWritten) {
+    ConversionContext& context = worker.context;
+    const SynthesisSettings& settings = context.settings;
+    ConversionOutcome outcome;
+    worker.outputArena.reset();
+
+    // Estimate the peak from the header; without one, assume raw files hold their pixels and
+    // compressed ones expand about tenfold
+    cv::Size imageSize;
+    bool probed = readImageSize(inputPath, imageSize) && imageSize.area() > 0;
+    std::error_code error;
+    size_t fileSize = static_cast<size_t>(std::filesystem::file_size(inputPath, error));
+    if (error) {
+        fileSize = 0;
+    }
+    size_t estimate = probed ? estimateJobMemory(imageSize, 4, settings, true) : fileSize * (isRawImage(inputPath) ? 3 : 10);
+
+    // Output that fits the retained block is already charged. A worker that has to wait for room
+    // gives its block up first, so idle workers hold nothing while others need memory
+    size_t outputEstimate = probed ? static_cast<size_t>(imageSize.width) * settings.samplesPerRow * sizeof(short) : 0;
+    size_t charge = estimate - std::min(outputEstimate, worker.arenaCharge);
+    if (!context.budget.tryAcquire(charge)) {
+        worker.outputArena.release();
+        context.budget.release(worker.arenaCharge);
+        worker.arenaCharge = 0;
+        charge = estimate;
+
+        // Blocks until the job fits, so workers stop pulling inputs while memory is short
+        context.budget.acquire(charge);
+    }
+    MemoryReservation reservation(context.budget, charge, std::adopt_lock);
+
+    cv::Mat alphaChannel;
+    cv::Mat processedImage = processImage(inputPath, alphaChannel, context.decodeOptions);
+    if (processedImage.empty()) {
+        return outcome;
+    }
+
+    // The first input with these pixels renders them; later ones reuse its output
+    if (context.deduplicate) {
+        auto pixelKey = std::make_tuple(processedImage.rows, processedImage.cols, hashImagePlanes(processedImage, alphaChannel));
+        std::lock_guard<std::mutex> lock(context.mutex);
+        auto seen = context.pixelsSeen.emplace(pixelKey, id);
+        if (!seen.second) {
+            context.pixelDuplicates++;
+            outcome.result = ConversionResult::Duplicate;
+            outcome.duplicateOf = seen.first->second;
+            return outcome;
+        }
+    }
+
+    RenderCost cost = estimateRenderCost(processedImage, settings);
+    outcome.predictedSeconds = cost.predictedSeconds(context.batchOptions.costModel);
+
+    // Output buffers are written synchronously and then dropped, so each worker reuses one block
+    // sized to its largest render instead of faulting in fresh pages for every image. The async
+    // writer takes ownership of the samples, so those stay in a job-owned buffer. Growing the block
+    // moves that much of the job's charge over to it
+    size_t sampleCount = static_cast<size_t>(processedImage.rows) * settings.samplesPerRow;
+    short* output = nullptr;
+    if (!context.writer) {
+        size_t retained = worker.outputArena.capacity();
+        worker.outputArena.reserve(sampleCount * sizeof(short));
+        worker.arenaCharge += reservation.detach(worker.outputArena.capacity() - retained);
+        output = static_cast<short*>(worker.outputArena.allocate(sampleCount * sizeof(short), alignof(short)));
+    }
+
+    std::shared_ptr<RenderJob> job = context.scheduler.submit(processedImage, alphaChannel, settings, RenderPriority::Normal, output);
+    processedImage.release();
+    alphaChannel.release();
+    context.scheduler.wait(job);
+    outcome.renderSeconds = job->renderSeconds;
+    outcome.result = ConversionResult::Converted;
+
+    auto outputStart = std::chrono::steady_clock::now();
+    if (context.writer) {
+        context.writer->write(outputPath, std::move(job->ownedSamples), settings, std::move(onWritten));
+    }
+    else {
+        bool written = writeWavFile(outputPath, job->output, sampleCount, settings);
+        if (onWritten) {
+            onWritten(written);
+        }
+    }
+    auto outputEnd = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(context.mutex);
+    context.outputSeconds += std::chrono::duration<double>(outputEnd - outputStart).count();
+    context.predictedSeconds += outcome.predictedSeconds;
+    context.renderSeconds += outcome.renderSeconds;
+    context.totalTaps += static_cast<double>(cost.activeColumns) * cost.samplesPerRow;
+    context.totalSamples += static_cast<double>(cost.rows) * cost.samplesPerRow;
+    return outcome;
+}
+
+int runBatch(const std::vector<std::string>& inputPaths, const DecodeOptions& decodeOptions, const BatchOptions& batchOptions) {
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    int renderWorkers = batchOptions.jobs > 0 ? batchOptions.jobs : static_cast<int>(hardwareThreads);
+    int workerCount = renderWorkers;
+    workerCount = std::min(workerCount, static_cast<int>(inputPaths.size()));
+
+    std::vector<BatchInput> inputs;
+    int failures = 0;
+
+    for (const std::string& inputPath : inputPaths) {
+        if (!isStillImage(inputPath)) {
+            std::cerr << "Error: " << inputPath << " is not a still image and is skipped in batch mode." << std::endl;
+            failures++;
+            continue;
+        }
+
+        BatchInput input;
+        input.path = inputPath;
+        std::error_code error;
+        input.fileSize = static_cast<size_t>(std::filesystem::file_size(inputPath, error));
+        if (error) {
+            input.fileSize = 0;
+        }
+
+        // Without a header, fall back on the file size as a rough proxy for the pixel count
+        if (readImageSize(inputPath, input.imageSize)) {
+            input.headerCost = static_cast<double>(input.imageSize.width) * input.imageSize.height;
+        }
+        else {
+            input.headerCost = static_cast<double>(input.fileSize);
+        }
+        inputs.push_back(input);
+    }
+
+    // Longest job first: large images start decoding early instead of being the last ones left
+    std::stable_sort(inputs.begin(), inputs.end(), [](const BatchInput& a, const BatchInput& b) { return a.headerCost > b.headerCost; });
+
+    // First level of deduplication: byte-identical files under different names
+    std::map<std::pair<size_t, uint64_t>, size_t> filesSeen;
+    std::vector<size_t> uniqueInputs;
+    int fileDuplicates = 0;
+
+    for (size_t index = 0; index < inputs.size(); ++index) {
+        MappedFile mappedFile;
+        if (mapFile(mappedFile, inputs[index].path)) {
+            inputs[index].fileHash = hashBytes(mappedFile.data, mappedFile.size);
+
+            auto seen = filesSeen.emplace(std::make_pair(inputs[index].fileSize, inputs[index].fileHash), index);
+            if (!seen.second) {
+                inputs[index].duplicateOf = seen.first->second;
+                fileDuplicates++;
+                continue;
+            }
+        }
+        uniqueInputs.push_back(index);
+    }
+
+    workerCount = std::max(1, std::min(workerCount, static_cast<int>(uniqueInputs.size())));
+    std::cout << "Converting " << uniqueInputs.size() << " unique of " << inputs.size() << " images with " << workerCount << " workers..." << std::endl;
+
+    ConversionContext context(decodeOptions, batchOptions, true);
+    std::atomic<size_t> nextInput{ 0 };
+    std::atomic<int> workerFailures{ 0 };
+    auto batchStart = std::chrono::steady_clock::now();
+
+    auto worker = [&]() {
+        ConversionWorker conversionWorker(context);
+
+        for (size_t next = nextInput++; next < uniqueInputs.size(); next = nextInput++) {
+            size_t index = uniqueInputs[next];
+            BatchInput& input = inputs[index];
+            auto inputStart = std::chrono::steady_clock::now();
+            std::string outputPath = outputPathFor(input.path);
+
+            // Counted as converted once the output reports back, which finish() waits for below
+            // when it is asynchronous
+            ConversionOutcome outcome = convertStillImage(conversionWorker, index, input.path, outputPath, [&input, &workerFailures](bool succeeded) {
+                input.converted = succeeded;
+                if (!succeeded) {
+                    workerFailures++;
+                }
+            });
+            if (outcome.result == ConversionResult::Failed) {
+                workerFailures++;
+                continue;
+            }
+            if (outcome.result == ConversionResult::Duplicate) {
+                input.duplicateOf = outcome.duplicateOf;
+                continue;
+            }
+            if (!context.writer && !input.converted) {
+                continue;
+            }
+
+            input.processingSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - inputStart).count();
+
+            std::lock_guard<std::mutex> lock(context.mutex);
+            std::cout << "File Output: " << outputPath << " (render predicted " << std::fixed << std::setprecision(3)
+                << outcome.predictedSeconds << " s, actual " << outcome.renderSeconds << " s)" << std::endl;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < workerCount; ++i) {
+        workers.emplace_back(worker);
+    }
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+
+    auto drainStart = std::chrono::steady_clock::now();
+    if (context.writer) {
+        context.writer->finish();
+    }
+    double drainSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - drainStart).count();
+
+    // Duplicates get their outputs once every original is written. A file copy of an input that
+    // itself turned out to repeat another's pixels points at an input without an output, so links
+    // follow the chain to the input that was rendered
+    auto renderedInput = [&](size_t index) {
+        for (size_t steps = 0; inputs[index].duplicateOf != SIZE_MAX && steps < inputs.size(); ++steps) {
+            index = inputs[index].duplicateOf;
+        }
+        return index;
+    };
+
+    double savedSeconds = 0.0;
+    for (const BatchInput& input : inputs) {
+        if (input.duplicateOf == SIZE_MAX) {
+            continue;
+        }
+
+        const BatchInput& original = inputs[renderedInput(input.duplicateOf)];
+        std::string outputPath = outputPathFor(input.path);
+        if (!original.converted || !linkOutput(outputPathFor(original.path), outputPath)) {
+            std::cerr << "Error: Could not create " << outputPath << " from the output of duplicate " << original.path << "." << std::endl;
+            failures++;
+            continue;
+        }
+
+        savedSeconds += original.processingSeconds;
+        std::cout << "File Output: " << outputPath << " (duplicate of " << original.path << ")" << std::endl;
+    }
+
+    double batchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+    failures += workerFailures;
+
+    if (fileDuplicates + context.pixelDuplicates > 0) {
+        std::cout << "Duplicates: " << fileDuplicates << " identical files, " << context.pixelDuplicates << " identical images, saved about "
+            << std::fixed << std::setprecision(3) << savedSeconds << " s" << std::endl;
+    }
+
+    // Render times are summed over workers, so divide by the pool size to compare with wall time
+    std::cout << "Batch finished in " << std::fixed << std::setprecision(3) << batchSeconds << " s; render predicted "
+        << context.predictedSeconds << " s, actual " << context.renderSeconds << " s of worker time ("
+        << context.renderSeconds / renderWorkers << " s per worker)." << std::endl;
+
+    // Solve the per-tap cost from the measured time, keeping the per-sample overhead fixed
+    if (context.totalTaps > 0.0) {
+        double sampleSeconds = context.totalSamples * batchOptions.costModel.nanosecondsPerSample * 1e-9;
+        double calibrated = std::max(0.0, context.renderSeconds - sampleSeconds) / context.totalTaps * 1e9;
+        std::cout << "Calibrated cost: --ns-per-tap " << std::setprecision(2) << calibrated << std::endl;
+    }
+
+    // Run the same batch with and without --async-output on the target disk to compare
+    std::cout << "Output: " << (context.writer ? context.writer->backendName() : "synchronous libsndfile") << ", workers blocked "
+        << std::fixed << std::setprecision(3) << context.outputSeconds << " s";
+    if (context.writer) {
+        std::cout << ", final drain " << drainSeconds << " s";
+    }
+    std::cout << std::endl;
+
+    context.scheduler.printNodeMetrics(std::cout);
+    context.budget.printStatistics(std::cout);
+
+    if (failures > 0) {
+        std::cerr << "Error: " << failures << " of " << inputPaths.size() << " images failed." << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "SoundCanvas.h"
+#include "Scheduler.h"
+#include "AsyncWriter.h"
+#include "Arena.h"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+// Render pool, memory budget and writer shared by the workers of a batch or watch run, with the
+// totals their summaries report; the fields after the mutex are guarded by it
+struct ConversionContext {
+    ConversionContext(const DecodeOptions& decodeOptions, const BatchOptions& batchOptions, bool deduplicate);
+
+    ConversionContext(const ConversionContext&) = delete;
+    ConversionContext& operator=(const ConversionContext&) = delete;
+
+    DecodeOptions decodeOptions;
+    BatchOptions batchOptions;
+    SynthesisSettings settings;
+    RenderScheduler scheduler;
+    MemoryBudget budget;
+    std::unique_ptr<AsyncWavWriter> writer; // Set with --async-output
+    bool deduplicate; // Later inputs with the pixels of an earlier one reuse its output
+
+    std::mutex mutex;
+    std::map<std::tuple<int, int, uint64_t>, size_t> pixelsSeen; // Identical pixels in different encodings, to the id that renders them
+    int pixelDuplicates = 0;
+    double predictedSeconds = 0.0;
+    double renderSeconds = 0.0;
+    double outputSeconds = 0.0; // Worker time blocked on output, the cost the async writer hides
+    double totalTaps = 0.0;
+    double totalSamples = 0.0;
+};
+
+// Output block one worker reuses from image to image, charged to the budget while it is held
+class ConversionWorker {
+public:
+    explicit ConversionWorker(ConversionContext& context);
+    ~ConversionWorker();
+
+    ConversionWorker(const ConversionWorker&) = delete;
+    ConversionWorker& operator=(const ConversionWorker&) = delete;
+
+    ConversionContext& context;
+    ScratchArena outputArena;
+    size_t arenaCharge = 0;
+};
+
+enum class ConversionResult {
+    Converted, // Rendered and handed to the output; onWritten reports whether the WAV was written
+    Duplicate, // Same pixels as input duplicateOf, nothing rendered
+    Failed
+};
+
+struct ConversionOutcome {
+    ConversionResult result = ConversionResult::Failed;
+    size_t duplicateOf = SIZE_MAX;
+    double predictedSeconds = 0.0;
+    double renderSeconds = 0.0;
+};
+
+// Decodes, renders and writes one still image under the context's budget. id names the input
+// for deduplication; onWritten runs once the WAV is written or has failed, on the writer thread
+// with --async-output and before returning otherwise
+ConversionOutcome convertStillImage(ConversionWorker& worker, size_t id, const std::string& inputPath, const std::string& outputPath,
+    std::function<void(bool)> onWritten);
@@ -0,0 +1,76 @@
+#include "SoundCanvasApi.h"
+#include "SoundCanvas.h"
+#include "Arena.h"
+
+#include <iostream>
+
+struct SoundCanvasImage {
+    cv::Mat image;
+    cv::Mat alphaChannel;
+    SynthesisSettings settings;
+};
+
+// Exceptions must not unwind into the caller's runtime, so every entry point catches them
+
+SoundCanvasImage* soundcanvas_prepare(const uint8_t* pixels, int width, int height, int channels, size_t rowStride) {
+    if (!pixels || width <= 0 || height <= 0 || channels < 1 || channels > 4 || rowStride < static_cast<size_t>(width) * channels) {
+        std::cerr << "Error: Invalid image passed to soundcanvas_prepare." << std::endl;
+        return nullptr;
+    }
+
+    try {
+        // Wraps the caller's buffer without copying; preprocessing writes its own planes
+        cv::Mat image(height, width, CV_8UC(channels), const_cast<uint8_t*>(pixels), rowStride);
+
+        auto prepared = std::make_unique<SoundCanvasImage>();
+        prepared->image = preprocessFrame(image, prepared->alphaChannel, true);
+        if (prepared->image.empty()) {
+            return nullptr;
+        }
+        return prepared.release();
+    }
+    catch (const std::exception& exception) {
+        std::cerr << "Error: " << exception.what() << std::endl;
+        return nullptr;
+    }
+}
+
+void soundcanvas_release(SoundCanvasImage* image) {
+    delete image;
+}
+
+int soundcanvas_rows(const SoundCanvasImage* image) {
+    return image ? image->image.rows : 0;
+}
+
+int soundcanvas_samples_per_row(void) {
+    return SynthesisSettings().samplesPerRow;
+}
+
+int soundcanvas_sample_rate(void) {
+    return SynthesisSettings().sampleRate;
+}
+
+int soundcanvas_render_rows(const SoundCanvasImage* image, int firstRow, int rowCount, int16_t* output) {
+    if (!image || !output || firstRow < 0 || rowCount < 0 || firstRow + rowCount > image->image.rows) {
+        return -1;
+    }
+
+    try {
+        ScratchArena scratch;
+        for (int row = firstRow; row < firstRow + rowCount; ++row) {
+            scratch.reset();
+            renderRows(image->image, image->alphaChannel, row, 1, image->settings,
+                output + static_cast<size_t>(row - firstRow) * image->settings.samplesPerRow, &scratch);
+        }
+        return 0;
+    }
+    catch (const std::exception& exception) {
+        std::cerr << "Error: " << exception.what() << std::endl;
+        return -1;
+    }
+}
+
+void soundcanvas_audible_range(const int16_t* samples, size_t count, size_t* begin, size_t* end) {
+    findAudibleRange(samples, count, *begin, *end);
+}
@@ -0,0 +1,185 @@
+#include "SoundCanvas.h"
+#include "Scheduler.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Splits a decoded image into one intensity plane per output channel plus alpha, all turned to
+// synthesis orientation. Stereo keeps the gray intensity and pans it by hue, warm colors to the
+// left and cool colors to the right, with constant power so a pixel sounds equally loud anywhere
+bool prepareChannelPlanes(const cv::Mat& image, bool rgbOrder, ColorMode mode, std::vector<cv::Mat>& planes, cv::Mat& alphaChannel) {
+    std::vector<cv::Mat> source;
+    cv::split(image, source);
+
+    cv::Mat red, green, blue, gray;
+    if (image.channels() == 1 || image.channels() == 2) {
+        red = green = blue = gray = source[0];
+        alphaChannel = image.channels() == 2 ? source[1] : cv::Mat();
+    }
+    else if (image.channels() == 3 || image.channels() == 4) {
+        red = source[rgbOrder ? 0 : 2];
+        green = source[1];
+        blue = source[rgbOrder ? 2 : 0];
+        alphaChannel = image.channels() == 4 ? source[3] : cv::Mat();
+        cv::cvtColor(image, gray, image.channels() == 4 ? (rgbOrder ? cv::COLOR_RGBA2GRAY : cv::COLOR_BGRA2GRAY)
+            : (rgbOrder ? cv::COLOR_RGB2GRAY : cv::COLOR_BGR2GRAY));
+    }
+    else {
+        std::cerr << "Error: Image does not have 1 to 4 channels." << std::endl;
+        return false;
+    }
+
+    if (mode == ColorMode::Rgb) {
+        planes = { red, green, blue };
+    }
+    else {
+        // Pan position from the blue/red balance, tabulated once for every difference
+        double leftGains[511];
+        double rightGains[511];
+        for (int difference = -255; difference <= 255; ++difference) {
+            double angle = (difference + 255) / 510.0 * (CV_PI / 2.0);
+            leftGains[difference + 255] = std::cos(angle);
+            rightGains[difference + 255] = std::sin(angle);
+        }
+
+        cv::Mat left(image.size(), CV_8U);
+        cv::Mat right(image.size(), CV_8U);
+        for (int y = 0; y < image.rows; ++y) {
+            const uchar* grayRow = gray.ptr<uchar>(y);
+            const uchar* redRow = red.ptr<uchar>(y);
+            const uchar* blueRow = blue.ptr<uchar>(y);
+            uchar* leftRow = left.ptr<uchar>(y);
+            uchar* rightRow = right.ptr<uchar>(y);
+            for (int x = 0; x < image.cols; ++x) {
+                int pan = blueRow[x] - redRow[x] + 255;
+                leftRow[x] = cv::saturate_cast<uchar>(grayRow[x] * leftGains[pan]);
+                rightRow[x] = cv::saturate_cast<uchar>(grayRow[x] * rightGains[pan]);
+            }
+        }
+        planes = { left, right };
+    }
+
+    for (cv::Mat& plane : planes) {
+        plane = orientPlane(plane);
+    }
+    if (!alphaChannel.empty()) {
+        alphaChannel = orientPlane(alphaChannel);
+    }
+    return true;
+}
+
+// Renders one row of every channel. Each column's sine is evaluated once per sample and reused for
+// all channels; amplitudes are interleaved per column, padded to Lanes, so the channel sums are one
+// vector operation. The sines of a sample are a plain map over the columns, which vector math
+// libraries evaluate several columns at a time. Each channel matches a mono render of its plane.
+template <int Lanes>
+void synthesizeChannelRow(const std::vector<cv::Mat>& planes, const cv::Mat& alphaChannel, int row, const SynthesisSettings& settings,
+    short* output, std::pmr::memory_resource* scratch) {
+    int cols = planes[0].cols;
+    int channels = static_cast<int>(planes.size());
+    const uchar* alphaRow = alphaRowOf(alphaChannel, row);
+    const uchar* intensityRows[Lanes] = {};
+    for (int channel = 0; channel < channels; ++channel) {
+        intensityRows[channel] = planes[channel].ptr<uchar>(row);
+    }
+
+    std::pmr::vector<double> frequencies(scratch);
+    std::pmr::vector<double> amplitudes(scratch);
+    frequencies.reserve(cols);
+    amplitudes.reserve(static_cast<size_t>(cols) * Lanes);
+
+    for (int col = 0; col < cols; ++col) {
+        double columnAmplitudes[Lanes] = {};
+        bool audible = false;
+        for (int channel = 0; channel < channels; ++channel) {
+            uchar intensity = intensityRows[channel][col];
+            if (intensity != 0) {
+                columnAmplitudes[channel] = alphaRow ? pixelAmplitude(intensity, alphaRow[col]) : opaqueAmplitude(intensity);
+                audible = true;
+            }
+        }
+
+        // Columns silent in every channel contribute nothing
+        if (audible) {
+            frequencies.push_back(columnFrequency(col, cols, settings));
+            amplitudes.insert(amplitudes.end(), columnAmplitudes, columnAmplitudes + Lanes);
+        }
+    }
+
+    size_t count = frequencies.size();
+    std::pmr::vector<double> sines(count, scratch);
+    long long firstSample = static_cast<long long>(row) * settings.samplesPerRow;
+
+    for (int i = 0; i < settings.samplesPerRow; ++i) {
+        double t = static_cast<double>(firstSample + i) / settings.sampleRate;
+        for (size_t k = 0; k < count; ++k) {
+            sines[k] = sin(2.0 * CV_PI * frequencies[k] * t);
+        }
+
+        double sampleValues[Lanes] = {};
+        for (size_t k = 0; k < count; ++k) {
+            for (int lane = 0; lane < Lanes; ++lane) {
+                sampleValues[lane] += amplitudes[k * Lanes + lane] * sines[k];
+            }
+        }
+
+        for (int channel = 0; channel < channels; ++channel) {
+            output[static_cast<size_t>(i) * channels + channel] = static_cast<short>(std::clamp(sampleValues[channel], -1.0, 1.0) * 32767);
+        }
+    }
+}
+
+} // namespace
+
+bool generateColorWavFile(const std::string& outputFilePath, const std::string& inputPath, const DecodeOptions& decodeOptions, ColorMode mode,
+    const BatchOptions& batchOptions) {
+    // Color is needed even from JPEGs, which otherwise decode straight to grayscale
+    DecodeOptions options = decodeOptions;
+    options.keepColor = true;
+
+    bool rgbOrder = false;
+    MappedFile mappedFile;
+    cv::Mat image = decodeInput(inputPath, options, mappedFile, rgbOrder);
+    if (image.empty()) {
+        std::cerr << "Error: Could not open or find the image." << std::endl;
+        return false;
+    }
+
+    std::vector<cv::Mat> planes;
+    cv::Mat alphaChannel;
+    if (!prepareChannelPlanes(image, rgbOrder, mode, planes, alphaChannel)) {
+        return false;
+    }
+
+    SynthesisSettings settings;
+    settings.channels = static_cast<int>(planes.size());
+    int rows = planes[0].rows;
+    size_t frameCount = static_cast<size_t>(rows) * settings.samplesPerRow;
+    SampleBuffer samples(frameCount * settings.channels);
+
+    // Rows go out as blocks on the shared scheduler, so --jobs and NUMA placement apply here too
+    RenderScheduler scheduler(batchOptions.jobs > 0 ? batchOptions.jobs : static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<RenderJob> job = scheduler.submit(rows, [&](int row, std::pmr::memory_resource* scratch) {
+        short* output = samples.data() + static_cast<size_t>(row) * settings.samplesPerRow * settings.channels;
+        if (settings.channels == 2) {
+            synthesizeChannelRow<2>(planes, alphaChannel, row, settings, output, scratch);
+        }
+        else {
+            synthesizeChannelRow<4>(planes, alphaChannel, row, settings, output, scratch);
+        }
+    }, settings, RenderPriority::Normal);
+    scheduler.wait(job);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Rendered " << settings.channels << " channels in " << std::fixed << std::setprecision(3) << seconds << " s." << std::endl;
+
+    return writeWavFile(outputFilePath, samples.data(), samples.size(), settings);
+}
@@ -0,0 +1,191 @@
+#include "SoundCanvas.h"
+#include "StripeReader.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int stripeRows = 16;
+const size_t maxQueuedStripes = 4;
+
+// Gray and alpha of consecutive input rows, which are consecutive frequencies
+struct FrequencyStripe {
+    cv::Mat gray;
+    cv::Mat alpha;
+    int firstInputRow = 0;
+};
+
+// Adds one oscillator's contribution across the whole timeline; alphas is null for opaque images.
+// The oscillator advances by a fixed rotation per sample instead of calling sin, restarting from
+// the exact phase at each time row so rounding never builds up over more than one row
+void accumulateOscillator(const uchar* intensities, const uchar* alphas, int timeRows, double frequency, const SynthesisSettings& settings, float* output) {
+    double step = 2.0 * CV_PI * frequency / settings.sampleRate;
+    double cosStep = std::cos(step);
+    double sinStep = std::sin(step);
+
+    for (int time = 0; time < timeRows; ++time) {
+        if (intensities[time] == 0) {
+            continue; // Black pixels contribute nothing
+        }
+
+        double amplitude = alphas ? pixelAmplitude(intensities[time], alphas[time]) : opaqueAmplitude(intensities[time]);
+        long long firstSample = static_cast<long long>(time) * settings.samplesPerRow;
+        double phase = step * static_cast<double>(firstSample);
+        double sine = std::sin(phase);
+        double cosine = std::cos(phase);
+        float* samples = output + firstSample;
+
+        for (int i = 0; i < settings.samplesPerRow; ++i) {
+            samples[i] += static_cast<float>(amplitude * sine);
+            double nextSine = sine * cosStep + cosine * sinStep;
+            cosine = cosine * cosStep - sine * sinStep;
+            sine = nextSine;
+        }
+    }
+}
+
+} // namespace
+
+bool generateFrequencyMajorWav(const std::string& outputFilePath, const std::string& inputPath, const DecodeOptions& options, const BatchOptions& batchOptions) {
+    if (options.targetOscillators > 0) {
+        std::cerr << "Error: --oscillators needs the whole image and cannot be combined with --frequency-major." << std::endl;
+        return false;
+    }
+
+    StripeReader reader;
+    if (!reader.open(inputPath, options)) {
+        std::cerr << "Error: Could not open or find the image." << std::endl;
+        return false;
+    }
+
+    // Input row y is frequency column height - 1 - y and input column x is time row x, the layout
+    // preprocessFrame would produce, so no transpose is needed at all
+    SynthesisSettings settings;
+    int timeRows = reader.width;
+    int frequencyCols = reader.height;
+    size_t sampleCount = static_cast<size_t>(timeRows) * settings.samplesPerRow;
+
+    // Every worker owns a full-length accumulator, so the memory budget caps the worker count
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    int requestedWorkers = batchOptions.jobs > 0 ? batchOptions.jobs : static_cast<int>(hardwareThreads);
+    size_t budget = batchOptions.memoryBudget > 0 ? batchOptions.memoryBudget : defaultMemoryBudget;
+    size_t accumulatorBytes = sampleCount * sizeof(float);
+    int workerCount = static_cast<int>(std::min<size_t>(requestedWorkers, std::max<size_t>(1, budget / accumulatorBytes)));
+    if (workerCount < requestedWorkers) {
+        std::cout << "Using " << workerCount << " of " << requestedWorkers << " workers to keep their " << (accumulatorBytes >> 20)
+            << " MB accumulators within the " << (budget >> 20) << " MB memory budget." << std::endl;
+    }
+    workerCount = std::min(workerCount, std::max(1, (frequencyCols + stripeRows - 1) / stripeRows));
+
+    std::vector<std::vector<float>> accumulators(workerCount);
+    std::deque<FrequencyStripe> queue;
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    bool decodingDone = false;
+    auto start = std::chrono::steady_clock::now();
+
+    // Workers synthesize stripes while the next ones decode
+    auto worker = [&](int index) {
+        std::vector<float>& output = accumulators[index];
+        output.assign(sampleCount, 0.0f);
+
+        while (true) {
+            FrequencyStripe stripe;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueChanged.wait(lock, [&]() { return decodingDone || !queue.empty(); });
+                if (queue.empty()) {
+                    return;
+                }
+                stripe = std::move(queue.front());
+                queue.pop_front();
+            }
+            queueChanged.notify_all();
+
+            for (int row = 0; row < stripe.gray.rows; ++row) {
+                int col = frequencyCols - 1 - (stripe.firstInputRow + row);
+                accumulateOscillator(stripe.gray.ptr<uchar>(row), alphaRowOf(stripe.alpha, row), timeRows,
+                    columnFrequency(col, frequencyCols, settings), settings, output.data());
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < workerCount; ++i) {
+        workers.emplace_back(worker, i);
+    }
+
+    bool decodingFailed = false;
+    for (int firstRow = 0; firstRow < frequencyCols; firstRow += stripeRows) {
+        cv::Mat rows = reader.read(std::min(stripeRows, frequencyCols - firstRow));
+        FrequencyStripe stripe;
+        stripe.firstInputRow = firstRow;
+        stripe.gray = rows.empty() ? cv::Mat() : splitGrayAlpha(rows, stripe.alpha, reader.rgbOrder);
+        if (stripe.gray.empty()) {
+            decodingFailed = true;
+            break;
+        }
+
+        // Copied out of the reader, whose stripe buffer is reused by the next read
+        if (stripe.gray.data == rows.data) {
+            stripe.gray = stripe.gray.clone();
+        }
+
+        std::unique_lock<std::mutex> lock(queueMutex);
+        queueChanged.wait(lock, [&]() { return queue.size() < maxQueuedStripes; });
+        queue.push_back(std::move(stripe));
+        queueChanged.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        decodingDone = true;
+        if (decodingFailed) {
+            queue.clear();
+        }
+    }
+    queueChanged.notify_all();
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+
+    if (decodingFailed) {
+        return false;
+    }
+
+    // Merge the accumulators, each worker summing its own slice of the timeline
+    SampleBuffer samples(sampleCount);
+    std::vector<std::thread> mergers;
+    size_t sliceSize = (sampleCount + workerCount - 1) / workerCount;
+    for (int i = 0; i < workerCount; ++i) {
+        mergers.emplace_back([&, i]() {
+            size_t begin = std::min(sampleCount, static_cast<size_t>(i) * sliceSize);
+            size_t end = std::min(sampleCount, begin + sliceSize);
+            for (size_t sample = begin; sample < end; ++sample) {
+                float sum = 0.0f;
+                for (const std::vector<float>& accumulator : accumulators) {
+                    sum += accumulator[sample];
+                }
+                samples[sample] = static_cast<short>(std::clamp(sum, -1.0f, 1.0f) * 32767);
+            }
+        });
+    }
+    for (std::thread& thread : mergers) {
+        thread.join();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Rendered " << frequencyCols << " oscillators in decode order with " << workerCount << " workers in "
+        << std::fixed << std::setprecision(3) << seconds << " s." << std::endl;
+
+    return writeWavFile(outputFilePath, samples.data(), sampleCount, settings);
+}
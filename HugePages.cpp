@@ -0,0 +1,196 @@
+#include "SoundCanvas.h"
+#include "Scheduler.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+const size_t hugePageSize = 2 * 1024 * 1024;
+const std::align_val_t bufferAlignment{ 64 }; // Matches what OpenCV's own allocator guarantees
+
+std::atomic<bool> hugePagesEnabled{ false };
+std::atomic<uint64_t> hugetlbBuffers{ 0 };
+std::atomic<uint64_t> transparentBuffers{ 0 };
+std::atomic<uint64_t> regularBuffers{ 0 };
+
+size_t roundToHugePages(size_t bytes) {
+    return (bytes + hugePageSize - 1) / hugePageSize * hugePageSize;
+}
+
+#ifdef __linux__
+void* mapHugePages(size_t size) {
+    // Reserved hugetlbfs pages first; most systems have none configured, so this fails fast
+    void* buffer = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (buffer != MAP_FAILED) {
+        hugetlbBuffers++;
+        return buffer;
+    }
+
+    // Transparent huge pages need a 2 MB aligned range, so map one page more and trim both ends
+    char* region = static_cast<char*>(mmap(nullptr, size + hugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (region == MAP_FAILED) {
+        return nullptr;
+    }
+
+    char* aligned = reinterpret_cast<char*>(roundToHugePages(reinterpret_cast<uintptr_t>(region)));
+    size_t head = static_cast<size_t>(aligned - region);
+    if (head > 0) {
+        munmap(region, head);
+    }
+    if (hugePageSize - head > 0) {
+        munmap(aligned + size, hugePageSize - head);
+    }
+
+    // Still a valid mapping when THP is disabled, it just stays on 4 KB pages
+    if (madvise(aligned, size, MADV_HUGEPAGE) == 0) {
+        transparentBuffers++;
+    }
+    else {
+        regularBuffers++;
+    }
+    return aligned;
+}
+#endif
+
+// cv::Mat allocator that takes its buffers from allocateLargeBuffer, after OpenCV's StdMatAllocator
+class LargeBufferMatAllocator : public cv::MatAllocator {
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, cv::AccessFlag, cv::UMatUsageFlags) const override {
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; --i) {
+            if (step) {
+                if (data && step[i] != CV_AUTOSTEP) {
+                    total = step[i];
+                }
+                else {
+                    step[i] = total;
+                }
+            }
+            total *= sizes[i];
+        }
+
+        cv::UMatData* matData = new cv::UMatData(this);
+        matData->data = matData->origdata = data ? static_cast<uchar*>(data) : static_cast<uchar*>(allocateLargeBuffer(total));
+        matData->size = total;
+        if (data) {
+            matData->flags |= cv::UMatData::USER_ALLOCATED;
+        }
+        return matData;
+    }
+
+    bool allocate(cv::UMatData* matData, cv::AccessFlag, cv::UMatUsageFlags) const override {
+        return matData != nullptr;
+    }
+
+    void deallocate(cv::UMatData* matData) const override {
+        if (!matData) {
+            return;
+        }
+        if (!(matData->flags & cv::UMatData::USER_ALLOCATED)) {
+            freeLargeBuffer(matData->origdata, matData->size);
+        }
+        delete matData;
+    }
+};
+
+LargeBufferMatAllocator matAllocator;
+
+} // namespace
+
+void* allocateLargeBuffer(size_t bytes) {
+#ifdef __linux__
+    // Anything of a huge page or more is mapped directly, so the same sizes always take the same
+    // path and freeing does not depend on whether huge pages were enabled at allocation time
+    if (bytes >= hugePageSize) {
+        size_t size = roundToHugePages(bytes);
+        if (hugePagesEnabled) {
+            if (void* buffer = mapHugePages(size)) {
+                return buffer;
+            }
+        }
+
+        void* buffer = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffer == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        regularBuffers++;
+        return buffer;
+    }
+#endif
+    return ::operator new(bytes, bufferAlignment);
+}
+
+void freeLargeBuffer(void* buffer, size_t bytes) {
+#ifdef __linux__
+    if (bytes >= hugePageSize) {
+        munmap(buffer, roundToHugePages(bytes));
+        return;
+    }
+#endif
+    ::operator delete(buffer, bufferAlignment);
+}
+
+void setHugePages(bool enabled) {
+#ifdef __linux__
+    hugePagesEnabled = enabled;
+    cv::Mat::setDefaultAllocator(enabled ? &matAllocator : cv::Mat::getStdAllocator());
+#else
+    if (enabled) {
+        std::cerr << "Error: Huge pages are only supported on Linux; using regular pages." << std::endl;
+    }
+#endif
+}
+
+void printHugePageStatistics(std::ostream& out) {
+    out << "Large buffers: " << hugetlbBuffers << " hugetlbfs, " << transparentBuffers << " transparent huge pages, "
+        << regularBuffers << " regular pages" << std::endl;
+}
+
+int runHugePageBenchmark(const std::string& imagePath, const DecodeOptions& options, int iterations) {
+    SynthesisSettings settings;
+    RenderScheduler scheduler(static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+
+    // Same image and worker pool both ways; the best of each is kept to filter out noise
+    for (bool hugePages : { false, true }) {
+        setHugePages(hugePages);
+        double bestDecodeSeconds = 0.0;
+        double bestRenderSeconds = 0.0;
+
+        for (int iteration = 0; iteration < iterations; ++iteration) {
+            auto decodeStart = std::chrono::steady_clock::now();
+            cv::Mat alphaChannel;
+            cv::Mat processedImage = processImage(imagePath, alphaChannel, options);
+            if (processedImage.empty()) {
+                setHugePages(false);
+                return 1;
+            }
+
+            auto renderStart = std::chrono::steady_clock::now();
+            std::shared_ptr<RenderJob> job = scheduler.submit(processedImage, alphaChannel, settings, RenderPriority::Normal);
+            scheduler.wait(job);
+            auto renderEnd = std::chrono::steady_clock::now();
+
+            double decodeSeconds = std::chrono::duration<double>(renderStart - decodeStart).count();
+            double renderSeconds = std::chrono::duration<double>(renderEnd - renderStart).count();
+            bestDecodeSeconds = iteration == 0 ? decodeSeconds : std::min(bestDecodeSeconds, decodeSeconds);
+            bestRenderSeconds = iteration == 0 ? renderSeconds : std::min(bestRenderSeconds, renderSeconds);
+        }
+
+        std::cout << (hugePages ? "Huge pages" : "4 KB pages") << ": decode and preprocess " << std::fixed << std::setprecision(3)
+            << bestDecodeSeconds << " s, render " << bestRenderSeconds << " s (best of " << iterations << ")" << std::endl;
+    }
+
+    printHugePageStatistics(std::cout);
+    setHugePages(false);
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include "SoundCanvas.h"
+#include "Scheduler.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const uint32_t sidecarMagic = 0x52434e53; // "SNCR"
+
+// Layout: this header, one hash per row, then the untrimmed render in host byte order; it is a
+// local cache, so it is simply rebuilt when anything about it does not match
+struct SidecarHeader {
+    uint32_t magic = sidecarMagic;
+    int32_t rows = 0;
+    int32_t cols = 0;
+    int32_t sampleRate = 0;
+    int32_t samplesPerRow = 0;
+    double minFrequency = 0.0;
+    double maxFrequency = 0.0;
+};
+
+bool sameLayout(const SidecarHeader& a, const SidecarHeader& b) {
+    return a.magic == b.magic && a.rows == b.rows && a.cols == b.cols && a.sampleRate == b.sampleRate
+        && a.samplesPerRow == b.samplesPerRow && a.minFrequency == b.minFrequency && a.maxFrequency == b.maxFrequency;
+}
+
+uint64_t hashRow(const cv::Mat& image, const cv::Mat& alphaChannel, int row) {
+    uint64_t hash = hashBytes(image.ptr<uchar>(row), image.cols);
+    return alphaChannel.empty() ? hash : hashBytes(alphaChannel.ptr<uchar>(row), alphaChannel.cols, hash);
+}
+
+} // namespace
+
+bool generateIncrementalWav(const std::string& outputFilePath, const cv::Mat& image, const cv::Mat& alphaChannel, const BatchOptions& batchOptions) {
+    if (image.empty() || (!alphaChannel.empty() && image.size() != alphaChannel.size())) {
+        std::cerr << "Error: No image data to convert to WAV." << std::endl;
+        return false;
+    }
+
+    SynthesisSettings settings;
+    std::string sidecarPath = outputFilePath + ".render";
+    auto start = std::chrono::steady_clock::now();
+
+    SidecarHeader header;
+    header.rows = image.rows;
+    header.cols = image.cols;
+    header.sampleRate = settings.sampleRate;
+    header.samplesPerRow = settings.samplesPerRow;
+    header.minFrequency = settings.minFrequency;
+    header.maxFrequency = settings.maxFrequency;
+
+    std::vector<uint64_t> rowHashes(image.rows);
+    for (int row = 0; row < image.rows; ++row) {
+        rowHashes[row] = hashRow(image, alphaChannel, row);
+    }
+
+    // Reuse the previous render when the sidecar describes the same layout
+    size_t sampleCount = static_cast<size_t>(image.rows) * settings.samplesPerRow;
+    SampleBuffer samples(sampleCount);
+    std::vector<uint64_t> savedHashes;
+    {
+        std::ifstream sidecar(sidecarPath, std::ios::binary);
+        SidecarHeader saved;
+        if (sidecar.read(reinterpret_cast<char*>(&saved), sizeof(saved)) && sameLayout(saved, header)) {
+            savedHashes.resize(image.rows);
+            sidecar.read(reinterpret_cast<char*>(savedHashes.data()), savedHashes.size() * sizeof(uint64_t));
+            sidecar.read(reinterpret_cast<char*>(samples.data()), sampleCount * sizeof(short));
+            if (!sidecar) {
+                savedHashes.clear();
+            }
+        }
+    }
+
+    std::vector<int> changedRows;
+    for (int row = 0; row < image.rows; ++row) {
+        if (savedHashes.empty() || savedHashes[row] != rowHashes[row]) {
+            changedRows.push_back(row);
+        }
+    }
+
+    // Every sample depends only on its own row and absolute position, so changed rows are rendered
+    // straight into their fixed place in the untrimmed buffer
+    RenderScheduler scheduler(batchOptions.jobs > 0 ? batchOptions.jobs : static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+    std::shared_ptr<RenderJob> job = scheduler.submit(static_cast<int>(changedRows.size()), [&](int index, std::pmr::memory_resource* scratch) {
+        int row = changedRows[index];
+        renderRows(image, alphaChannel, row, 1, settings, samples.data() + static_cast<size_t>(row) * settings.samplesPerRow, scratch);
+    }, settings, RenderPriority::Normal);
+    scheduler.wait(job);
+
+    // Patch the changed rows into the sidecar in place; a missing or stale one is written in full
+    if (!savedHashes.empty()) {
+        std::fstream sidecar(sidecarPath, std::ios::binary | std::ios::in | std::ios::out);
+        // Samples go in before their hash, so an interrupted update leaves rows that look changed
+        // rather than stale samples under a current hash
+        for (int row : changedRows) {
+            std::streamoff sampleOffset = sizeof(SidecarHeader) + static_cast<std::streamoff>(image.rows) * sizeof(uint64_t)
+                + static_cast<std::streamoff>(row) * settings.samplesPerRow * sizeof(short);
+            sidecar.seekp(sampleOffset);
+            sidecar.write(reinterpret_cast<const char*>(samples.data() + static_cast<size_t>(row) * settings.samplesPerRow),
+                settings.samplesPerRow * sizeof(short));
+        }
+        sidecar.flush();
+        for (int row : changedRows) {
+            sidecar.seekp(sizeof(SidecarHeader) + static_cast<std::streamoff>(row) * sizeof(uint64_t));
+            sidecar.write(reinterpret_cast<const char*>(&rowHashes[row]), sizeof(uint64_t));
+        }
+        if (!sidecar) {
+            std::cerr << "Error: Could not update " << sidecarPath << "; the next run renders everything again." << std::endl;
+            std::remove(sidecarPath.c_str());
+        }
+    }
+    else {
+        std::ofstream sidecar(sidecarPath, std::ios::binary | std::ios::trunc);
+        sidecar.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        sidecar.write(reinterpret_cast<const char*>(rowHashes.data()), rowHashes.size() * sizeof(uint64_t));
+        sidecar.write(reinterpret_cast<const char*>(samples.data()), sampleCount * sizeof(short));
+        if (!sidecar) {
+            std::cerr << "Error: Could not write " << sidecarPath << "." << std::endl;
+        }
+    }
+
+    // Trimming depends on the whole render, so the WAV itself is always written again
+    if (!writeWavFile(outputFilePath, samples.data(), sampleCount, settings)) {
+        return false;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Rendered " << changedRows.size() << " of " << image.rows << " rows"
+        << (savedHashes.empty() ? "" : " that changed") << " in " << std::fixed << std::setprecision(3) << seconds << " s." << std::endl;
+    return true;
+}
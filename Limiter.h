@@ -0,0 +1,37 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <utility>
+#include <vector>
+
+// Lookahead peak limiter. The gain applied to a sample is the smallest gain any sample within the
+// lookahead needs, averaged over the same length, so it has fully ramped down by the time a peak
+// arrives and ramps back up as smoothly afterwards; output trails input by lookahead - 1 samples
+class LookaheadLimiter {
+public:
+    LookaheadLimiter(int lookahead, double ceiling)
+        : lookahead(std::max(1, lookahead)), ceiling(ceiling), heldGains(this->lookahead, 1.0), delayed(this->lookahead, 0.0),
+        heldSum(this->lookahead) {
+    }
+
+    // Returns false while the delay line is still filling
+    bool process(double input, double& output);
+
+    // Pushing this much silence through brings out every sample still in the delay line
+    int delay() const {
+        return lookahead - 1;
+    }
+
+    long long limitedSamples = 0; // Input samples that were over the ceiling
+    double minimumGain = 1.0;
+
+private:
+    int lookahead;
+    double ceiling;
+    std::deque<std::pair<long long, double>> minima; // Increasing required gains with their sample index
+    std::vector<double> heldGains;
+    std::vector<double> delayed;
+    double heldSum;
+    long long index = 0;
+};
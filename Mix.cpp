@@ -0,0 +1,135 @@
+#include "SoundCanvas.h"
+#include "Scheduler.h"
+
+#include <iostream>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct MixLayer {
+    cv::Mat image;
+    cv::Mat alphaChannel;
+    double gain = 1.0;
+    int firstRow = 0; // Output row the layer starts on
+};
+
+// Layers of the same width share a frequency map, so they share one oscillator per column
+struct LayerGroup {
+    int cols = 0;
+    std::vector<const MixLayer*> layers;
+};
+
+} // namespace
+
+int runMix(const std::vector<std::string>& inputPaths, const DecodeOptions& decodeOptions, const BatchOptions& batchOptions, const MixOptions& mixOptions) {
+    SynthesisSettings settings;
+    if ((!mixOptions.gains.empty() && mixOptions.gains.size() != inputPaths.size())
+        || (!mixOptions.offsetMilliseconds.empty() && mixOptions.offsetMilliseconds.size() != inputPaths.size())) {
+        std::cerr << "Error: --gains and --offsets-ms need one value per image." << std::endl;
+        return 1;
+    }
+
+    std::vector<MixLayer> layers(inputPaths.size());
+    int outputRows = 0;
+    for (size_t i = 0; i < inputPaths.size(); ++i) {
+        MixLayer& layer = layers[i];
+        layer.image = processImage(inputPaths[i], layer.alphaChannel, decodeOptions);
+        if (layer.image.empty()) {
+            return 1;
+        }
+
+        // Offsets snap to whole rows, the grain the image itself has on the timeline. Layers of one
+        // width share an oscillator per column and row, so a layer cannot start partway into a row
+        double rowMilliseconds = 1000.0 * settings.samplesPerRow / settings.sampleRate;
+        double offset = mixOptions.offsetMilliseconds.empty() ? 0.0 : mixOptions.offsetMilliseconds[i];
+        layer.firstRow = static_cast<int>(std::lround(offset / rowMilliseconds));
+        if (std::abs(layer.firstRow * rowMilliseconds - offset) > 1e-6) {
+            std::cout << "Offset of " << inputPaths[i] << " rounded from " << offset << " ms to " << layer.firstRow * rowMilliseconds
+                << " ms, the nearest multiple of the " << rowMilliseconds << " ms row." << std::endl;
+        }
+        layer.gain = mixOptions.gains.empty() ? 1.0 : mixOptions.gains[i];
+        outputRows = std::max(outputRows, layer.firstRow + layer.image.rows);
+    }
+
+    std::vector<LayerGroup> groups;
+    for (const MixLayer& layer : layers) {
+        auto group = std::find_if(groups.begin(), groups.end(), [&](const LayerGroup& candidate) { return candidate.cols == layer.image.cols; });
+        if (group == groups.end()) {
+            groups.push_back({ layer.image.cols, {} });
+            group = groups.end() - 1;
+        }
+        group->layers.push_back(&layer);
+    }
+
+    if (groups.size() > 1) {
+        std::cout << "Layers have " << groups.size() << " different widths; each width keeps its own oscillators "
+            "(use --oscillators to give them one frequency map)." << std::endl;
+    }
+
+    // Per output row, the amplitudes of every layer in a group are summed column by column and the
+    // groups' oscillators go into one bank, so the sine evaluations scale with distinct frequencies
+    // rather than with layers; mixing before the clamp also keeps layers from clipping on their own
+    size_t sampleCount = static_cast<size_t>(outputRows) * settings.samplesPerRow;
+    SampleBuffer samples(sampleCount);
+    RenderScheduler scheduler(batchOptions.jobs > 0 ? batchOptions.jobs : static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+    auto start = std::chrono::steady_clock::now();
+
+    auto renderRow = [&](int row, std::pmr::memory_resource* scratch) {
+        std::pmr::vector<double> frequencies(scratch);
+        std::pmr::vector<double> amplitudes(scratch);
+        std::pmr::vector<double> columnAmplitudes(scratch);
+
+        for (const LayerGroup& group : groups) {
+            columnAmplitudes.assign(group.cols, 0.0);
+            bool active = false;
+            for (const MixLayer* layer : group.layers) {
+                int layerRow = row - layer->firstRow;
+                if (layerRow < 0 || layerRow >= layer->image.rows || layer->gain == 0.0) {
+                    continue;
+                }
+
+                const uchar* intensityRow = layer->image.ptr<uchar>(layerRow);
+                const uchar* alphaRow = alphaRowOf(layer->alphaChannel, layerRow);
+                for (int col = 0; col < group.cols; ++col) {
+                    if (intensityRow[col] != 0) {
+                        double amplitude = alphaRow ? pixelAmplitude(intensityRow[col], alphaRow[col]) : opaqueAmplitude(intensityRow[col]);
+                        columnAmplitudes[col] += layer->gain * amplitude;
+                        active = true;
+                    }
+                }
+            }
+
+            if (!active) {
+                continue;
+            }
+            for (int col = 0; col < group.cols; ++col) {
+                if (columnAmplitudes[col] != 0.0) {
+                    frequencies.push_back(columnFrequency(col, group.cols, settings));
+                    amplitudes.push_back(columnAmplitudes[col]);
+                }
+            }
+        }
+
+        long long firstSample = static_cast<long long>(row) * settings.samplesPerRow;
+        synthesizeOscillators(frequencies.data(), amplitudes.data(), frequencies.size(), firstSample, settings, samples.data() + firstSample);
+    };
+
+    std::shared_ptr<RenderJob> job = scheduler.submit(outputRows, renderRow, settings, RenderPriority::Normal);
+    scheduler.wait(job);
+    double renderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::string outputPath = std::filesystem::path(outputPathFor(inputPaths.front())).stem().string() + "_mix.wav";
+    if (!writeWavFile(outputPath, samples.data(), sampleCount, settings)) {
+        return 1;
+    }
+
+    std::cout << "File Output: " << outputPath << " (" << layers.size() << " layers, " << groups.size() << " frequency "
+        << (groups.size() == 1 ? "map" : "maps") << ", render " << std::fixed << std::setprecision(3) << renderSeconds << " s)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include "SoundCanvas.h"
+#include "Arena.h"
+#include "Limiter.h"
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+const double peakTarget = 0.891; // -1 dBFS
+const double loudnessTarget = 0.2; // -14 dBFS RMS
+const double limiterCeiling = 0.98;
+
+void convertSamples(const double* values, size_t count, short* output) {
+    for (size_t i = 0; i < count; ++i) {
+        output[i] = static_cast<short>(std::clamp(values[i], -1.0, 1.0) * 32767);
+    }
+}
+
+} // namespace
+
+bool LookaheadLimiter::process(double input, double& output) {
+    double magnitude = std::abs(input);
+    double requiredGain = magnitude > ceiling ? ceiling / magnitude : 1.0;
+    if (requiredGain < 1.0) {
+        limitedSamples++;
+        minimumGain = std::min(minimumGain, requiredGain);
+    }
+
+    // Sliding minimum of the required gain over the lookahead window
+    while (!minima.empty() && minima.back().second >= requiredGain) {
+        minima.pop_back();
+    }
+    minima.emplace_back(index, requiredGain);
+    while (minima.front().first <= index - lookahead) {
+        minima.pop_front();
+    }
+
+    size_t slot = static_cast<size_t>(index % lookahead);
+    heldSum += minima.front().second - heldGains[slot];
+    heldGains[slot] = minima.front().second;
+    delayed[slot] = input;
+
+    bool ready = index >= lookahead - 1;
+    if (ready) {
+        output = delayed[static_cast<size_t>((index + 1) % lookahead)] * (heldSum / lookahead);
+    }
+    index++;
+    return ready;
+}
+
+double normalizationGain(const cv::Mat& image, const cv::Mat& alphaChannel, NormalizeMode mode) {
+    // A row is a sum of sines at distinct frequencies, so the sum of its amplitudes bounds its peak
+    // and half the sum of their squares is its mean power; both come from the pixels alone
+    double maxAmplitudeSum = 0.0;
+    double powerSum = 0.0;
+    int audibleRows = 0;
+
+    for (int row = 0; row < image.rows; ++row) {
+        const uchar* intensityRow = image.ptr<uchar>(row);
+        const uchar* alphaRow = alphaRowOf(alphaChannel, row);
+        double amplitudeSum = 0.0;
+        double squareSum = 0.0;
+        for (int col = 0; col < image.cols; ++col) {
+            if (intensityRow[col] != 0) {
+                double amplitude = alphaRow ? pixelAmplitude(intensityRow[col], alphaRow[col]) : opaqueAmplitude(intensityRow[col]);
+                amplitudeSum += amplitude;
+                squareSum += amplitude * amplitude;
+            }
+        }
+
+        maxAmplitudeSum = std::max(maxAmplitudeSum, amplitudeSum);
+        if (amplitudeSum > 0.0) {
+            powerSum += squareSum / 2.0;
+            audibleRows++;
+        }
+    }
+
+    if (audibleRows == 0) {
+        return 1.0;
+    }
+    if (mode == NormalizeMode::Peak) {
+        return peakTarget / maxAmplitudeSum;
+    }
+
+    // Silent rows are trimmed or are gaps, so they do not pull the loudness down
+    return loudnessTarget / std::sqrt(powerSum / audibleRows);
+}
+
+bool generateNormalizedWav(const std::string& outputFilePath, const cv::Mat& image, const cv::Mat& alphaChannel, NormalizeMode mode) {
+    if (image.empty() || (!alphaChannel.empty() && image.size() != alphaChannel.size())) {
+        std::cerr << "Error: No image data to convert to WAV." << std::endl;
+        return false;
+    }
+
+    SynthesisSettings settings;
+    double gain = normalizationGain(image, alphaChannel, mode);
+
+    WavStream stream;
+    if (!openWavStream(stream, outputFilePath, settings)) {
+        return false;
+    }
+
+    // Rendered in a single pass: the gain is folded into the amplitudes, and the limiter only
+    // holds back its few milliseconds of lookahead
+    LookaheadLimiter limiter(settings.sampleRate / 200, limiterCeiling);
+    std::vector<double> rowValues(settings.samplesPerRow);
+    std::vector<double> limitedValues;
+    std::vector<short> rowSamples;
+    limitedValues.reserve(settings.samplesPerRow);
+    ScratchArena scratch;
+
+    for (int row = 0; row < image.rows; ++row) {
+        scratch.reset();
+        std::pmr::vector<double> frequencies(&scratch);
+        std::pmr::vector<double> amplitudes(&scratch);
+        gatherOscillators(image.ptr<uchar>(row), alphaRowOf(alphaChannel, row), image.cols, settings, frequencies, amplitudes);
+        for (double& amplitude : amplitudes) {
+            amplitude *= gain;
+        }
+
+        long long firstSample = static_cast<long long>(row) * settings.samplesPerRow;
+        for (int i = 0; i < settings.samplesPerRow; ++i) {
+            double t = static_cast<double>(firstSample + i) / settings.sampleRate;
+            double sampleValue = 0.0;
+            for (size_t k = 0; k < frequencies.size(); ++k) {
+                sampleValue += amplitudes[k] * sin(2.0 * CV_PI * frequencies[k] * t);
+            }
+            rowValues[i] = sampleValue;
+        }
+
+        limitedValues.clear();
+        for (double value : rowValues) {
+            double output = 0.0;
+            if (limiter.process(value, output)) {
+                limitedValues.push_back(output);
+            }
+        }
+
+        rowSamples.resize(limitedValues.size());
+        convertSamples(limitedValues.data(), limitedValues.size(), rowSamples.data());
+        writeWavStream(stream, rowSamples.data(), rowSamples.size());
+    }
+
+    limitedValues.clear();
+    for (int i = limiter.delay(); i > 0; --i) {
+        double output = 0.0;
+        if (limiter.process(0.0, output)) {
+            limitedValues.push_back(output);
+        }
+    }
+    rowSamples.resize(limitedValues.size());
+    convertSamples(limitedValues.data(), limitedValues.size(), rowSamples.data());
+    writeWavStream(stream, rowSamples.data(), rowSamples.size());
+    closeWavStream(stream);
+
+    std::cout << "Normalized with a gain of " << std::fixed << std::setprecision(2) << 20.0 * std::log10(gain) << " dB";
+    if (limiter.limitedSamples > 0) {
+        std::cout << "; the limiter caught " << limiter.limitedSamples << " samples, at most "
+            << -20.0 * std::log10(limiter.minimumGain) << " dB";
+    }
+    std::cout << "." << std::endl;
+    return true;
+}
@@ -0,0 +1,286 @@
+#include "SoundCanvas.h"
+#include "Scheduler.h"
+#include "StripeReader.h"
+
+#include <iostream>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const int minTileSize = 64; // Keeps every tile a whole number of pages
+const int maxTileSize = 1024;
+
+// Temporary file mapped read-write, removed when it is closed. Pages are dropped from the working
+// set once used; the file keeps their contents, so resident memory stays at what is being touched
+class TileFile {
+public:
+    TileFile() = default;
+    TileFile(const TileFile&) = delete;
+    TileFile& operator=(const TileFile&) = delete;
+
+    ~TileFile() {
+#ifdef _WIN32
+        if (view) {
+            UnmapViewOfFile(view);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+#else
+        if (view) {
+            munmap(view, size);
+        }
+#endif
+    }
+
+    bool create(size_t bytes) {
+        size = bytes;
+#ifdef _WIN32
+        char directory[MAX_PATH];
+        char path[MAX_PATH];
+        if (!GetTempPathA(MAX_PATH, directory) || !GetTempFileNameA(directory, "snc", 0, path)) {
+            return false;
+        }
+
+        file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        fileSize.QuadPart = static_cast<LONGLONG>(bytes);
+        if (!SetFilePointerEx(file, fileSize, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) {
+            return false;
+        }
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, fileSize.HighPart, fileSize.LowPart, nullptr);
+        if (!mapping) {
+            return false;
+        }
+        view = static_cast<unsigned char*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+        pageSize = 4096;
+        return view != nullptr;
+#else
+        // TMPDIR picks the disk; a tmpfs /tmp would put the tiles back in memory
+        std::string path = (std::filesystem::temp_directory_path() / "soundcanvas-XXXXXX").string();
+        int descriptor = mkstemp(path.data());
+        if (descriptor < 0) {
+            return false;
+        }
+
+        // Unlinked right away, so the space is returned however the process ends
+        unlink(path.c_str());
+        void* mapped = MAP_FAILED;
+        if (ftruncate(descriptor, static_cast<off_t>(bytes)) == 0) {
+            mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+        }
+        close(descriptor);
+
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        view = static_cast<unsigned char*>(mapped);
+        pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return true;
+#endif
+    }
+
+    unsigned char* data() const {
+        return view;
+    }
+
+    void release(size_t offset, size_t bytes) {
+        // Only whole pages inside the range, so neighbouring tiles are never affected
+        size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+        size_t end = (offset + bytes) / pageSize * pageSize;
+        if (end <= begin) {
+            return;
+        }
+#ifdef _WIN32
+        // Unlocking pages that were never locked removes them from the working set
+        VirtualUnlock(view + begin, end - begin);
+#else
+        madvise(view + begin, end - begin, MADV_DONTNEED);
+#endif
+    }
+
+private:
+    unsigned char* view = nullptr;
+    size_t size = 0;
+    size_t pageSize = 4096;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+// Largest tile edge whose working set fits: writing holds a decoded stripe, its gray and alpha
+// planes and the tiles it dirties, reading holds a band of tiles, its copy and its samples
+int chooseTileSize(int width, int height, const SynthesisSettings& settings, size_t memoryBudget, size_t& workingSet) {
+    auto bytesFor = [&](size_t tile) {
+        size_t writing = 8 * tile * static_cast<size_t>(width);
+        size_t reading = 4 * tile * static_cast<size_t>(height) + 2 * tile * static_cast<size_t>(settings.samplesPerRow);
+        return std::max(writing, reading);
+    };
+
+    int tile = minTileSize;
+    while (tile < maxTileSize && bytesFor(static_cast<size_t>(tile) * 2) <= memoryBudget) {
+        tile *= 2;
+    }
+    workingSet = bytesFor(tile);
+    return tile;
+}
+
+} // namespace
+
+bool generateOutOfCoreWav(const std::string& outputFilePath, const std::string& inputPath, const DecodeOptions& options, const BatchOptions& batchOptions) {
+    if (options.targetOscillators > 0) {
+        std::cerr << "Error: --oscillators needs the whole image and cannot be combined with --out-of-core." << std::endl;
+        return false;
+    }
+
+    StripeReader reader;
+    if (!reader.open(inputPath, options)) {
+        std::cerr << "Error: Could not open or find the image." << std::endl;
+        return false;
+    }
+
+    // Synthesis reads input columns as time rows: time row t, frequency column c is input pixel
+    // (height - 1 - c, t), the same orientation preprocessFrame produces by rotating and flipping
+    SynthesisSettings settings;
+    int timeRows = reader.width;
+    int frequencyCols = reader.height;
+    size_t budget = batchOptions.memoryBudget > 0 ? batchOptions.memoryBudget : defaultMemoryBudget;
+    size_t workingSet = 0;
+    int tile = chooseTileSize(timeRows, frequencyCols, settings, budget, workingSet);
+    if (workingSet > budget) {
+        // Not fatal: the smallest tiles are the best this mode can do, and the render still completes
+        std::cout << "A " << reader.width << "x" << reader.height << " image needs about " << (workingSet >> 20)
+            << " MB even with the smallest tiles, over the " << (budget >> 20) << " MB memory budget." << std::endl;
+    }
+
+    // Tiles hold gray and alpha interleaved in synthesis orientation and are stored band by band,
+    // so each band of time rows is one contiguous range of the file
+    int tileRows = (timeRows + tile - 1) / tile;
+    int tileCols = (frequencyCols + tile - 1) / tile;
+    size_t tileBytes = static_cast<size_t>(tile) * tile * 2;
+    auto tileOffset = [&](int tileRow, int tileCol) {
+        return (static_cast<size_t>(tileRow) * tileCols + tileCol) * tileBytes;
+    };
+
+    TileFile tiles;
+    if (!tiles.create(tileOffset(tileRows, 0))) {
+        std::cerr << "Error: Could not create the temporary tile file." << std::endl;
+        return false;
+    }
+    std::cout << "Transposing through " << (tileOffset(tileRows, 0) >> 20) << " MB of " << tile << "x" << tile
+        << " tiles with a working set of about " << (workingSet >> 20) << " MB." << std::endl;
+
+    // Each stripe of input rows fills one column of tiles; decoder order runs from the last
+    // frequency column to the first
+    auto transposeStart = std::chrono::steady_clock::now();
+    bool opaque = true; // Images without alpha render without reading it back
+    for (int tileCol = tileCols - 1; tileCol >= 0; --tileCol) {
+        int firstCol = tileCol * tile;
+        int colCount = std::min(tile, frequencyCols - firstCol);
+        int firstInputRow = frequencyCols - (firstCol + colCount);
+
+        cv::Mat stripe = reader.read(colCount);
+        cv::Mat alphaStripe;
+        cv::Mat grayStripe = stripe.empty() ? cv::Mat() : splitGrayAlpha(stripe, alphaStripe, reader.rgbOrder);
+        if (grayStripe.empty()) {
+            return false;
+        }
+        opaque = opaque && alphaStripe.empty();
+
+        for (int tileRow = 0; tileRow < tileRows; ++tileRow) {
+            unsigned char* destination = tiles.data() + tileOffset(tileRow, tileCol);
+            int firstTime = tileRow * tile;
+            int timeCount = std::min(tile, timeRows - firstTime);
+
+            // One tile at a time, so the scattered writes stay in cache
+            for (int i = 0; i < colCount; ++i) {
+                int col = frequencyCols - 1 - (firstInputRow + i) - firstCol;
+                const uchar* grayRow = grayStripe.ptr<uchar>(i) + firstTime;
+                const uchar* alphaRow = alphaStripe.empty() ? nullptr : alphaStripe.ptr<uchar>(i) + firstTime;
+                for (int time = 0; time < timeCount; ++time) {
+                    unsigned char* pixel = destination + (static_cast<size_t>(time) * tile + col) * 2;
+                    pixel[0] = grayRow[time];
+                    pixel[1] = alphaRow ? alphaRow[time] : 255;
+                }
+            }
+            tiles.release(tileOffset(tileRow, tileCol), tileBytes);
+        }
+    }
+    double transposeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - transposeStart).count();
+
+    WavStream stream;
+    if (!openWavStream(stream, outputFilePath, settings)) {
+        return false;
+    }
+
+    // Bands of time rows come back out in order; each is copied out of its tiles, released and
+    // rendered as one job on a scheduler that lives across all bands
+    auto renderStart = std::chrono::steady_clock::now();
+    RenderScheduler scheduler(batchOptions.jobs > 0 ? batchOptions.jobs : static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+    cv::Mat band(tile, frequencyCols, CV_8U);
+    cv::Mat alphaBand(tile, frequencyCols, CV_8U);
+    SampleBuffer bandSamples(static_cast<size_t>(tile) * settings.samplesPerRow);
+
+    for (int tileRow = 0; tileRow < tileRows; ++tileRow) {
+        int firstTime = tileRow * tile;
+        int timeCount = std::min(tile, timeRows - firstTime);
+
+        for (int tileCol = 0; tileCol < tileCols; ++tileCol) {
+            const unsigned char* source = tiles.data() + tileOffset(tileRow, tileCol);
+            int firstCol = tileCol * tile;
+            int colCount = std::min(tile, frequencyCols - firstCol);
+            for (int time = 0; time < timeCount; ++time) {
+                const unsigned char* pixel = source + static_cast<size_t>(time) * tile * 2;
+                uchar* grayRow = band.ptr<uchar>(time) + firstCol;
+                uchar* alphaRow = alphaBand.ptr<uchar>(time) + firstCol;
+                for (int col = 0; col < colCount; ++col) {
+                    grayRow[col] = pixel[col * 2];
+                    alphaRow[col] = pixel[col * 2 + 1];
+                }
+            }
+        }
+        tiles.release(tileOffset(tileRow, 0), tileOffset(tileRow + 1, 0) - tileOffset(tileRow, 0));
+
+        std::shared_ptr<RenderJob> job = scheduler.submit(timeCount, [&](int time, std::pmr::memory_resource* scratch) {
+            synthesizeRow(band.ptr<uchar>(time), opaque ? nullptr : alphaBand.ptr<uchar>(time), frequencyCols,
+                static_cast<long long>(firstTime + time) * settings.samplesPerRow, settings,
+                bandSamples.data() + static_cast<size_t>(time) * settings.samplesPerRow, scratch);
+        }, settings, RenderPriority::Normal);
+        scheduler.wait(job);
+
+        writeWavStream(stream, bandSamples.data(), static_cast<size_t>(timeCount) * settings.samplesPerRow);
+    }
+
+    closeWavStream(stream);
+    double renderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+    std::cout << "Decoded and transposed in " << std::fixed << std::setprecision(3) << transposeSeconds << " s, rendered in "
+        << renderSeconds << " s." << std::endl;
+    return true;
+}
@@ -0,0 +1,401 @@
+#include "Scheduler.h"
+#include "Arena.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <cctype>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+// NUMA node and the CPUs on it this process may run on
+struct NumaNode {
+    int id = 0;
+    std::vector<int> cpus;
+};
+
+// Nodes from sysfs in id order; a single node with no CPUs listed means there is nothing to gain
+// from placement and workers are left unpinned
+std::vector<NumaNode> readNumaTopology() {
+    std::vector<NumaNode> nodes;
+
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return { NumaNode() };
+    }
+
+    // Node ids can be sparse, for example node0 and node2 on a machine with a memory-only or
+    // offline node, so they are listed rather than counted
+    std::vector<int> nodeIds;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() > 4 && name.compare(0, 4, "node") == 0
+            && std::all_of(name.begin() + 4, name.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            nodeIds.push_back(std::stoi(name.substr(4)));
+        }
+    }
+    std::sort(nodeIds.begin(), nodeIds.end());
+
+    for (int nodeId : nodeIds) {
+        std::ifstream cpuList("/sys/devices/system/node/node" + std::to_string(nodeId) + "/cpulist");
+        if (!cpuList) {
+            continue;
+        }
+
+        // Ranges such as "0-15,32-47"
+        std::vector<int> cpus;
+        std::string range;
+        while (std::getline(cpuList, range, ',')) {
+            int first = 0;
+            int last = 0;
+            char dash = 0;
+            std::istringstream rangeStream(range);
+            if (!(rangeStream >> first)) {
+                continue;
+            }
+            last = (rangeStream >> dash >> last) ? last : first;
+
+            for (int cpu = first; cpu <= last; ++cpu) {
+                if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+
+        if (!cpus.empty()) {
+            nodes.push_back({ nodeId, cpus });
+        }
+    }
+#endif
+
+    if (nodes.size() < 2) {
+        nodes.assign(1, NumaNode());
+    }
+    return nodes;
+}
+
+} // namespace
+
+RenderScheduler::RenderScheduler(int workerCount, int rowsPerBlock)
+    : rowsPerBlock(std::max(1, rowsPerBlock)) {
+    std::vector<NumaNode> nodes = readNumaTopology();
+    nodeMetrics.resize(nodes.size());
+    for (size_t node = 0; node < nodes.size(); ++node) {
+        nodeMetrics[node].id = nodes[node].id;
+    }
+
+    // Take CPUs from the nodes in turn, so a pool smaller than the machine still uses every node
+    std::vector<std::pair<int, int>> placements; // Index into nodes and CPU
+    for (size_t round = 0; placements.size() < static_cast<size_t>(std::max(1, workerCount)); ++round) {
+        size_t placed = placements.size();
+        for (size_t node = 0; node < nodes.size(); ++node) {
+            if (round < nodes[node].cpus.size()) {
+                placements.emplace_back(static_cast<int>(node), nodes[node].cpus[round]);
+            }
+        }
+        if (placements.size() == placed) {
+            break;
+        }
+    }
+
+    for (int i = 0; i < std::max(1, workerCount); ++i) {
+        // More workers than CPUs wrap around; without a topology, workers run unpinned on node 0
+        std::pair<int, int> placement = placements.empty() ? std::make_pair(0, -1) : placements[i % placements.size()];
+        nodeMetrics[placement.first].workers++;
+        workers.emplace_back(&RenderScheduler::workerLoop, this, placement.first, placement.second);
+    }
+}
+
+RenderScheduler::~RenderScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+std::shared_ptr<RenderJob> RenderScheduler::submit(const cv::Mat& image, const cv::Mat& alphaChannel, const SynthesisSettings& settings,
+    RenderPriority priority, short* output, bool inOrder) {
+    auto job = std::make_shared<RenderJob>();
+    job->priority = priority;
+    job->inOrder = inOrder;
+    job->image = image;
+    job->alphaChannel = alphaChannel;
+    job->settings = settings;
+    job->rows = image.rows;
+
+    if (output) {
+        job->output = output;
+    }
+    else {
+        job->ownedSamples.resize(static_cast<size_t>(image.rows) * settings.samplesPerRow);
+        job->output = job->ownedSamples.data();
+    }
+    return enqueue(std::move(job));
+}
+
+std::shared_ptr<RenderJob> RenderScheduler::submit(int rows, RowRenderer renderRow, const SynthesisSettings& settings, RenderPriority priority,
+    bool inOrder) {
+    auto job = std::make_shared<RenderJob>();
+    job->priority = priority;
+    job->inOrder = inOrder;
+    job->renderRow = std::move(renderRow);
+    job->rows = rows;
+    job->settings = settings;
+    return enqueue(std::move(job));
+}
+
+std::shared_ptr<RenderJob> RenderScheduler::enqueue(std::shared_ptr<RenderJob> job) {
+    job->submittedAt = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    int priorityClass = static_cast<int>(job->priority);
+    job->id = nextJobId++;
+    metrics[priorityClass].submitted++;
+
+    if (job->rows == 0) {
+        finishIfDrained(*job);
+        return job;
+    }
+
+    queues[priorityClass].push_back(job);
+    metrics[priorityClass].maxQueueDepth = std::max(metrics[priorityClass].maxQueueDepth, queues[priorityClass].size());
+    workAvailable.notify_all();
+    return job;
+}
+
+void RenderScheduler::cancel(const std::shared_ptr<RenderJob>& job) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (job->done) {
+        return;
+    }
+
+    job->cancelled = true;
+
+    // Rows not handed out yet are dropped now; blocks already running stop after their current row
+    auto& queue = queues[static_cast<int>(job->priority)];
+    queue.erase(std::remove(queue.begin(), queue.end(), job), queue.end());
+    finishIfDrained(*job);
+}
+
+bool RenderScheduler::waitFor(const std::shared_ptr<RenderJob>& job, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return jobChanged.wait_for(lock, timeout, [&]() { return job->done; });
+}
+
+void RenderScheduler::wait(const std::shared_ptr<RenderJob>& job) {
+    std::unique_lock<std::mutex> lock(mutex);
+    jobChanged.wait(lock, [&]() { return job->done; });
+}
+
+uint64_t RenderScheduler::jobsSubmitted() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return nextJobId - 1;
+}
+
+void RenderScheduler::printMetrics(std::ostream& out) {
+    static const char* classNames[priorityCount] = { "high", "normal", "low" };
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (int priorityClass = 0; priorityClass < priorityCount; ++priorityClass) {
+            const ClassMetrics& classMetrics = metrics[priorityClass];
+            double averageWait = classMetrics.waitCount > 0 ? classMetrics.totalWaitSeconds / classMetrics.waitCount : 0.0;
+
+            out << "Scheduler " << classNames[priorityClass] << ": queue depth " << queues[priorityClass].size()
+                << " (max " << classMetrics.maxQueueDepth << "), jobs " << classMetrics.submitted
+                << " submitted, " << classMetrics.completed << " completed, " << classMetrics.cancelled << " cancelled, wait "
+                << std::fixed << std::setprecision(2) << averageWait * 1000.0 << " ms avg / "
+                << classMetrics.maxWaitSeconds * 1000.0 << " ms max" << std::endl;
+        }
+    }
+
+    printNodeMetrics(out);
+}
+
+void RenderScheduler::printNodeMetrics(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // A node falling behind the others points at remote memory traffic
+    for (size_t node = 0; node < nodeMetrics.size(); ++node) {
+        const NodeMetrics& metricsOfNode = nodeMetrics[node];
+        double samplesPerSecond = metricsOfNode.renderSeconds > 0.0 ? metricsOfNode.samplesRendered / metricsOfNode.renderSeconds : 0.0;
+
+        out << "Scheduler node " << metricsOfNode.id << ": " << metricsOfNode.workers << " workers, " << metricsOfNode.rowsRendered
+            << " rows, " << std::fixed << std::setprecision(2) << samplesPerSecond / 1e6 << " Msamples/s per worker" << std::endl;
+    }
+}
+
+void RenderScheduler::workerLoop(int node, int cpu) {
+#ifdef __linux__
+    // Pinning keeps the pages a worker first touches on its own node; failure just leaves it floating
+    if (cpu >= 0) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+    }
+#else
+    (void)cpu;
+#endif
+
+    // Row tables come from this worker's arena, reused for every row of every job it renders
+    ScratchArena scratch;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        workAvailable.wait(lock, [&]() {
+            return stopping || std::any_of(std::begin(queues), std::end(queues), [](const auto& candidate) { return !candidate.empty(); });
+        });
+        if (stopping) {
+            return;
+        }
+
+        // Highest non-empty class first, round-robin between the jobs within it, so a huge render
+        // takes one block per turn and cannot hold up the small jobs queued behind it
+        auto queue = std::find_if(std::begin(queues), std::end(queues), [](const auto& candidate) { return !candidate.empty(); });
+        std::shared_ptr<RenderJob> job = queue->front();
+        queue->pop_front();
+
+        if (!job->started) {
+            job->started = true;
+            double waitSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - job->submittedAt).count();
+            ClassMetrics& classMetrics = metrics[static_cast<int>(job->priority)];
+            classMetrics.totalWaitSeconds += waitSeconds;
+            classMetrics.maxWaitSeconds = std::max(classMetrics.maxWaitSeconds, waitSeconds);
+            classMetrics.waitCount++;
+        }
+
+        int firstRow = job->nextRow;
+        int rowCount = std::min(rowsPerBlock, job->rows - firstRow);
+        job->nextRow += rowCount;
+        job->blocksInFlight++;
+
+        // A job that asked for in-order blocks keeps the front of its class until it is handed out
+        if (job->nextRow < job->rows) {
+            if (job->inOrder) {
+                queue->push_front(job);
+            }
+            else {
+                queue->push_back(job);
+            }
+        }
+
+        lock.unlock();
+
+        auto blockStart = std::chrono::steady_clock::now();
+        int rowsRendered = 0;
+        for (int row = firstRow; row < firstRow + rowCount && !job->cancelled; ++row) {
+            scratch.reset();
+            if (job->renderRow) {
+                job->renderRow(row, &scratch);
+            }
+            else {
+                renderRows(job->image, job->alphaChannel, row, 1, job->settings, job->output + static_cast<size_t>(row) * job->settings.samplesPerRow, &scratch);
+            }
+            ++rowsRendered;
+        }
+        double blockSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - blockStart).count();
+
+        lock.lock();
+        job->blocksInFlight--;
+        job->rowsDone += rowsRendered;
+        job->renderSeconds += blockSeconds;
+        nodeMetrics[node].rowsRendered += rowsRendered;
+        nodeMetrics[node].samplesRendered += static_cast<uint64_t>(rowsRendered) * job->settings.samplesPerRow;
+        nodeMetrics[node].renderSeconds += blockSeconds;
+        finishIfDrained(*job);
+    }
+}
+
+void RenderScheduler::finishIfDrained(RenderJob& job) {
+    if (job.done || job.blocksInFlight > 0 || (!job.cancelled && job.rowsDone < job.rows)) {
+        return;
+    }
+
+    job.done = true;
+
+    if (job.cancelled) {
+        // Give the memory back right away instead of when the last reference goes
+        SampleBuffer().swap(job.ownedSamples);
+        job.output = nullptr;
+        job.image.release();
+        job.alphaChannel.release();
+        job.renderRow = nullptr;
+        metrics[static_cast<int>(job.priority)].cancelled++;
+    }
+    else {
+        metrics[static_cast<int>(job.priority)].completed++;
+    }
+
+    jobChanged.notify_all();
+}
+
+MemoryBudget::MemoryBudget(size_t budgetBytes)
+    : budgetBytes(budgetBytes) {
+}
+
+void MemoryBudget::acquire(size_t bytes) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // A job larger than the whole budget is admitted once nothing else is running
+    auto fits = [&]() { return budgetBytes == 0 || bytesInUse == 0 || bytesInUse + bytes <= budgetBytes; };
+
+    if (!fits()) {
+        auto waitStart = std::chrono::steady_clock::now();
+        released.wait(lock, fits);
+        delayedJobs++;
+        totalDelaySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count();
+    }
+
+    bytesInUse += bytes;
+    peakBytesInUse = std::max(peakBytesInUse, bytesInUse);
+    admittedJobs++;
+}
+
+bool MemoryBudget::tryAcquire(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (budgetBytes != 0 && bytesInUse != 0 && bytesInUse + bytes > budgetBytes) {
+        return false;
+    }
+
+    bytesInUse += bytes;
+    peakBytesInUse = std::max(peakBytesInUse, bytesInUse);
+    admittedJobs++;
+    return true;
+}
+
+void MemoryBudget::release(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        bytesInUse -= std::min(bytes, bytesInUse);
+    }
+    released.notify_all();
+}
+
+void MemoryBudget::printStatistics(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const double megabyte = 1024.0 * 1024.0;
+
+    out << "Memory budget: peak estimate " << std::fixed << std::setprecision(1) << peakBytesInUse / megabyte << " MB";
+    if (budgetBytes > 0) {
+        out << " of " << budgetBytes / megabyte << " MB";
+    }
+    out << ", " << delayedJobs << " of " << admittedJobs << " jobs waited "
+        << std::setprecision(2) << totalDelaySeconds << " s in total" << std::endl;
+}
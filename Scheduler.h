@@ -0,0 +1,175 @@
+#pragma once
+
+#include "SoundCanvas.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+// Priority classes for renders sharing the worker pool, highest first
+enum class RenderPriority {
+    High = 0,
+    Normal = 1,
+    Low = 2
+};
+
+// Renders one row of a job that is not a plain image, such as a mix or a multichannel render;
+// it writes its own output and takes per-row tables from scratch
+using RowRenderer = std::function<void(int row, std::pmr::memory_resource* scratch)>;
+
+// One render split into row blocks that workers pick up independently
+struct RenderJob {
+    uint64_t id = 0; // Submission sequence
+    RenderPriority priority = RenderPriority::Normal;
+    bool inOrder = false; // Blocks go out back to back instead of taking turns with the rest of the class
+    cv::Mat image;
+    cv::Mat alphaChannel;
+    RowRenderer renderRow; // Used instead of the image when set
+    int rows = 0;
+    SynthesisSettings settings;
+    short* output = nullptr; // Caller's buffer, or ownedSamples when none was given; unused with renderRow
+    SampleBuffer ownedSamples; // Left uninitialized so pages are first touched by the workers that render them
+    std::chrono::steady_clock::time_point submittedAt;
+    std::atomic<bool> cancelled{ false };
+
+    // Guarded by the scheduler mutex
+    int nextRow = 0;
+    int rowsDone = 0;
+    int blocksInFlight = 0;
+    double renderSeconds = 0.0; // Worker time spent in this job's blocks
+    bool started = false;
+    bool done = false;
+};
+
+// Worker pool that renders row blocks of many jobs; higher priority classes go first and jobs
+// of the same class take turns block by block, so a huge render cannot hold up small ones.
+// Callers that consume rows as they finish can ask for a job's blocks in order instead.
+// On Linux, workers are pinned to CPUs spread evenly over the NUMA nodes. Only job-owned output
+// is placed by the rendering worker, and blocks do not end on page boundaries (16 default rows
+// are 141120 bytes), so neighbouring blocks share a page at each edge. Gray and alpha planes are
+// first touched by the thread that decoded them and are read across nodes
+class RenderScheduler {
+public:
+    explicit RenderScheduler(int workerCount, int rowsPerBlock = 16);
+    ~RenderScheduler();
+
+    RenderScheduler(const RenderScheduler&) = delete;
+    RenderScheduler& operator=(const RenderScheduler&) = delete;
+
+    std::shared_ptr<RenderJob> submit(const cv::Mat& image, const cv::Mat& alphaChannel, const SynthesisSettings& settings,
+        RenderPriority priority, short* output = nullptr, bool inOrder = false);
+    std::shared_ptr<RenderJob> submit(int rows, RowRenderer renderRow, const SynthesisSettings& settings, RenderPriority priority,
+        bool inOrder = false);
+    void cancel(const std::shared_ptr<RenderJob>& job);
+    bool waitFor(const std::shared_ptr<RenderJob>& job, std::chrono::milliseconds timeout);
+    void wait(const std::shared_ptr<RenderJob>& job);
+    uint64_t jobsSubmitted();
+    void printMetrics(std::ostream& out);
+    void printNodeMetrics(std::ostream& out);
+
+private:
+    static const int priorityCount = 3;
+
+    // Queue and latency statistics of one priority class
+    struct ClassMetrics {
+        uint64_t submitted = 0;
+        uint64_t completed = 0;
+        uint64_t cancelled = 0;
+        size_t maxQueueDepth = 0;
+        double totalWaitSeconds = 0.0; // Submission to first block started
+        double maxWaitSeconds = 0.0;
+        uint64_t waitCount = 0;
+    };
+
+    // Throughput of the workers placed on one NUMA node
+    struct NodeMetrics {
+        int id = 0; // Node id in sysfs, which need not match the index
+        int workers = 0;
+        uint64_t rowsRendered = 0;
+        uint64_t samplesRendered = 0;
+        double renderSeconds = 0.0;
+    };
+
+    std::shared_ptr<RenderJob> enqueue(std::shared_ptr<RenderJob> job);
+    void workerLoop(int node, int cpu);
+    void finishIfDrained(RenderJob& job);
+
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable jobChanged;
+    std::deque<std::shared_ptr<RenderJob>> queues[priorityCount]; // Jobs with rows left to hand out
+    ClassMetrics metrics[priorityCount];
+    std::vector<NodeMetrics> nodeMetrics;
+    std::vector<std::thread> workers;
+    int rowsPerBlock;
+    uint64_t nextJobId = 1;
+    bool stopping = false;
+};
+
+// Admission control that keeps the summed peak memory estimate of running jobs within a budget;
+// callers block in acquire until their job fits, which pushes back on whatever feeds them
+class MemoryBudget {
+public:
+    explicit MemoryBudget(size_t budgetBytes);
+
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    void acquire(size_t bytes);
+    bool tryAcquire(size_t bytes);
+    void release(size_t bytes);
+    void printStatistics(std::ostream& out);
+
+private:
+    std::mutex mutex;
+    std::condition_variable released;
+    size_t budgetBytes; // 0 for unlimited
+    size_t bytesInUse = 0;
+    size_t peakBytesInUse = 0;
+    uint64_t admittedJobs = 0;
+    uint64_t delayedJobs = 0;
+    double totalDelaySeconds = 0.0;
+};
+
+// Holds a share of a memory budget for as long as it lives
+class MemoryReservation {
+public:
+    MemoryReservation(MemoryBudget& budget, size_t bytes)
+        : budget(budget), bytes(bytes) {
+        budget.acquire(bytes);
+    }
+
+    // Takes over bytes the caller already acquired
+    MemoryReservation(MemoryBudget& budget, size_t bytes, std::adopt_lock_t)
+        : budget(budget), bytes(bytes) {
+    }
+
+    ~MemoryReservation() {
+        budget.release(bytes);
+    }
+
+    MemoryReservation(const MemoryReservation&) = delete;
+    MemoryReservation& operator=(const MemoryReservation&) = delete;
+
+    // Leaves up to count bytes charged when the reservation ends, for memory that outlives it;
+    // returns how many the caller now has to release
+    size_t detach(size_t count) {
+        count = std::min(count, bytes);
+        bytes -= count;
+        return count;
+    }
+
+private:
+    MemoryBudget& budget;
+    size_t bytes;
+};
@@ -0,0 +1,590 @@
+#include "SoundCanvas.h"
+#include "Scheduler.h"
+#include "Arena.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cstdint>
+#include <exception>
+#include <memory>
+
+#ifndef _WIN32
+#include <csignal>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+namespace {
+
+// Wire format between the service and its local clients, in host byte order
+const uint32_t serviceMagic = 0x53434e56; // "SCNV"
+
+// Largest image a request may describe, well past any real input but far from overflowing sizes
+const int32_t maxRequestSide = 1 << 16;
+const size_t maxRequestPixelBytes = size_t(1) << 30;
+
+enum ServiceTransport : uint32_t {
+    CopyTransport = 0, // Pixels follow the request and samples follow the response on the socket
+    SharedMemoryTransport = 1 // Input and output segments are passed as file descriptors
+};
+
+enum ServiceStatus : int32_t {
+    StatusOk = 0,
+    StatusBadRequest = 1,
+    StatusOutputTooSmall = 2 // sampleCount holds the required capacity
+};
+
+struct ServiceRequest {
+    uint32_t magic;
+    uint32_t transport;
+    int32_t width;
+    int32_t height;
+    int32_t channels; // 8-bit samples in gray, gray+alpha, RGB or RGBA order
+    int32_t priority; // RenderPriority: 0 high, 1 normal, 2 low
+    uint64_t outputCapacity; // Samples the shared output segment can hold
+};
+
+struct ServiceResponse {
+    int32_t status;
+    uint64_t sampleOffset; // Start of the trimmed audio within the output
+    uint64_t sampleCount;
+    uint64_t renderMicroseconds;
+};
+
+bool sendAll(int socket, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t sent = send(socket, bytes, size, 0);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        bytes += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool receiveAll(int socket, void* data, size_t size) {
+    char* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t received = recv(socket, bytes, size, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        bytes += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+// Sends a message with file descriptors attached through SCM_RIGHTS
+bool sendWithDescriptors(int socket, const void* data, size_t size, const int* descriptors, int descriptorCount) {
+    union {
+        char buffer[CMSG_SPACE(2 * sizeof(int))];
+        struct cmsghdr align;
+    } control = {};
+
+    struct iovec vector = { const_cast<void*>(data), size };
+    struct msghdr message = {};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+
+    if (descriptorCount > 0) {
+        message.msg_control = control.buffer;
+        message.msg_controllen = CMSG_SPACE(descriptorCount * sizeof(int));
+
+        struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(descriptorCount * sizeof(int));
+        std::memcpy(CMSG_DATA(header), descriptors, descriptorCount * sizeof(int));
+    }
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(socket, &message, 0);
+    } while (sent < 0 && errno == EINTR);
+
+    if (sent <= 0) {
+        return false;
+    }
+
+    // Descriptors travel with the first byte, the rest is plain data
+    return sendAll(socket, static_cast<const char*>(data) + sent, size - static_cast<size_t>(sent));
+}
+
+// Receives a message and up to two file descriptors attached to it
+bool receiveWithDescriptors(int socket, void* data, size_t size, int* descriptors, int& descriptorCount) {
+    union {
+        char buffer[CMSG_SPACE(2 * sizeof(int))];
+        struct cmsghdr align;
+    } control = {};
+
+    struct iovec vector = { data, size };
+    struct msghdr message = {};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+
+    ssize_t received;
+    do {
+        received = recvmsg(socket, &message, 0);
+    } while (received < 0 && errno == EINTR);
+
+    if (received <= 0) {
+        return false;
+    }
+
+    descriptorCount = 0;
+    for (struct cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+
+        size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < count; ++i) {
+            int descriptor;
+            std::memcpy(&descriptor, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+            if (descriptorCount < 2) {
+                descriptors[descriptorCount++] = descriptor;
+            }
+            else {
+                close(descriptor);
+            }
+        }
+    }
+
+    return receiveAll(socket, static_cast<char*>(data) + received, size - static_cast<size_t>(received));
+}
+
+// Client segment mapped into the service, unmapped when it goes out of scope
+struct SegmentMapping {
+    void* data = MAP_FAILED;
+    size_t size = 0;
+
+    SegmentMapping() = default;
+    SegmentMapping(const SegmentMapping&) = delete;
+    SegmentMapping& operator=(const SegmentMapping&) = delete;
+
+    ~SegmentMapping() {
+        if (data != MAP_FAILED) {
+            munmap(data, size);
+        }
+    }
+};
+
+// Maps a client segment after checking it is large enough and sealed against resizing, so the
+// client cannot shrink it under the mapping and fault the service
+bool mapSegment(SegmentMapping& mapping, int descriptor, size_t size, bool writable) {
+#ifdef __linux__
+    int seals = fcntl(descriptor, F_GET_SEALS);
+    if (seals < 0 || (seals & (F_SEAL_SHRINK | F_SEAL_GROW)) != (F_SEAL_SHRINK | F_SEAL_GROW)) {
+        return false;
+    }
+
+    struct stat segmentStatus;
+    if (fstat(descriptor, &segmentStatus) != 0 || static_cast<size_t>(segmentStatus.st_size) < size) {
+        return false;
+    }
+
+    mapping.data = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, descriptor, 0);
+    mapping.size = size;
+    return mapping.data != MAP_FAILED;
+#else
+    // Only Linux can seal a segment, and an unsealed one could be truncated under the mapping
+    (void)mapping;
+    (void)descriptor;
+    (void)size;
+    (void)writable;
+    return false;
+#endif
+}
+
+// Segment sized once and sealed against resizing, which the service requires before mapping it
+int createSharedMemory(size_t size) {
+#ifdef __linux__
+    int descriptor = memfd_create("soundcanvas", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    std::string name = "/soundcanvas-" + std::to_string(getpid()) + "-" + std::to_string(size);
+    int descriptor = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (descriptor >= 0) {
+        shm_unlink(name.c_str());
+    }
+#endif
+
+    if (descriptor >= 0 && ftruncate(descriptor, static_cast<off_t>(size)) != 0) {
+        close(descriptor);
+        return -1;
+    }
+
+#ifdef __linux__
+    if (descriptor >= 0 && fcntl(descriptor, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) != 0) {
+        close(descriptor);
+        return -1;
+    }
+#endif
+    return descriptor;
+}
+
+// A hung-up client reads as end of stream; pipelined requests just look like pending data
+bool clientDisconnected(int connection) {
+    char byte;
+    ssize_t peeked = recv(connection, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return peeked == 0 || (peeked < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+}
+
+void serveRequests(int connection, RenderScheduler& scheduler, MemoryBudget& budget) {
+    SynthesisSettings settings;
+    ScratchArena pixelArena; // Copied pixels of one request at a time, kept at the largest size seen
+
+    while (true) {
+        pixelArena.reset();
+        ServiceRequest request;
+        int descriptors[2];
+        int descriptorCount = 0;
+
+        if (!receiveWithDescriptors(connection, &request, sizeof(request), descriptors, descriptorCount)) {
+            break;
+        }
+
+        ServiceResponse response = {};
+        bool validRequest = request.magic == serviceMagic && request.width > 0 && request.height > 0
+            && request.width <= maxRequestSide && request.height <= maxRequestSide
+            && static_cast<size_t>(request.width) * request.height * request.channels <= maxRequestPixelBytes
+            && request.channels >= 1 && request.channels <= 4 && request.priority >= 0 && request.priority <= 2
+            && (request.transport == CopyTransport || (request.transport == SharedMemoryTransport && descriptorCount == 2));
+
+        if (!validRequest) {
+            for (int i = 0; i < descriptorCount; ++i) {
+                close(descriptors[i]);
+            }
+
+            // The stream may be out of sync with inline data, so give up on this client
+            response.status = StatusBadRequest;
+            sendAll(connection, &response, sizeof(response));
+            break;
+        }
+
+        size_t pixelBytes = static_cast<size_t>(request.width) * request.height * request.channels;
+        size_t requiredSamples = static_cast<size_t>(request.width) * settings.samplesPerRow; // Image columns become time rows
+
+        // Pixels are read off the socket only once the job fits, so clients queue up behind a full
+        // socket instead of the service growing; shared segments belong to the client and are not counted
+        bool copyTransport = request.transport == CopyTransport;
+        MemoryReservation reservation(budget, estimateJobMemory(cv::Size(request.width, request.height), request.channels, settings, copyTransport));
+
+        std::pmr::vector<unsigned char> copiedPixels(&pixelArena);
+        SegmentMapping inputSegment;
+        SegmentMapping outputSegment;
+        const unsigned char* pixels = nullptr;
+        short* samples = nullptr;
+
+        if (request.transport == SharedMemoryTransport) {
+            // Pixels are read and samples written in the client's own segments
+            if (request.outputCapacity < requiredSamples) {
+                response.status = StatusOutputTooSmall;
+                response.sampleCount = requiredSamples;
+            }
+            else if (!mapSegment(inputSegment, descriptors[0], pixelBytes, false)
+                || !mapSegment(outputSegment, descriptors[1], requiredSamples * sizeof(short), true)) {
+                response.status = StatusBadRequest;
+            }
+
+            close(descriptors[0]);
+            close(descriptors[1]);
+            pixels = static_cast<const unsigned char*>(inputSegment.data);
+            samples = static_cast<short*>(outputSegment.data);
+        }
+        else {
+            copiedPixels.resize(pixelBytes);
+            if (!receiveAll(connection, copiedPixels.data(), pixelBytes)) {
+                break;
+            }
+            pixels = copiedPixels.data();
+        }
+
+        std::shared_ptr<RenderJob> job;
+        auto renderStart = std::chrono::steady_clock::now();
+
+        if (response.status == StatusOk) {
+            cv::Mat image(request.height, request.width, CV_8UC(request.channels), const_cast<unsigned char*>(pixels));
+            cv::Mat alphaChannel;
+            cv::Mat processedImage = preprocessFrame(image, alphaChannel, true);
+
+            // Copy transport renders into a buffer owned by the job, so cancelling frees it at once
+            job = scheduler.submit(processedImage, alphaChannel, settings, static_cast<RenderPriority>(request.priority), samples);
+            copiedPixels.clear();
+            copiedPixels.shrink_to_fit();
+
+            // Cancel the render if the client hangs up while it is queued or running
+            while (!scheduler.waitFor(job, std::chrono::milliseconds(50))) {
+                if (clientDisconnected(connection)) {
+                    scheduler.cancel(job);
+                }
+            }
+        }
+
+        if (job && job->cancelled) {
+            break;
+        }
+
+        if (job) {
+            samples = job->output;
+
+            size_t begin, end;
+            findAudibleRange(samples, requiredSamples, begin, end);
+            response.sampleOffset = begin;
+            response.sampleCount = end - begin;
+            response.renderMicroseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - renderStart).count());
+        }
+
+        bool sent = sendAll(connection, &response, sizeof(response));
+        if (sent && response.status == StatusOk && request.transport == CopyTransport) {
+            sent = sendAll(connection, samples + response.sampleOffset, response.sampleCount * sizeof(short));
+        }
+
+        if (!sent) {
+            break;
+        }
+    }
+}
+
+// Each client runs on its own detached thread, so anything a request throws ends that client
+// rather than the whole service
+void serveConnection(int connection, RenderScheduler& scheduler, MemoryBudget& budget) {
+    try {
+        serveRequests(connection, scheduler, budget);
+    }
+    catch (const std::exception& exception) {
+        std::cerr << "Error: Dropping a client after a failed request: " << exception.what() << std::endl;
+    }
+
+    close(connection);
+}
+
+int connectToService(const std::string& socketPath) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error: Socket path is too long." << std::endl;
+        return -1;
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0 || connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "Error: Could not connect to " << socketPath << "." << std::endl;
+        if (connection >= 0) {
+            close(connection);
+        }
+        return -1;
+    }
+
+    return connection;
+}
+
+// Pool and budget shared by the client and metrics threads. Those are detached and hold their
+// own reference, so the state outlives runService when it returns on a failed accept
+struct ServiceState {
+    ServiceState(int workerCount, size_t memoryBudget)
+        : scheduler(workerCount), budget(memoryBudget) {
+    }
+
+    RenderScheduler scheduler;
+    MemoryBudget budget;
+};
+
+} // namespace
+#endif
+
+int runService(const std::string& socketPath, size_t memoryBudget) {
+#ifdef _WIN32
+    (void)socketPath;
+    (void)memoryBudget;
+    std::cerr << "Error: Service mode needs Unix domain sockets with descriptor passing." << std::endl;
+    return 1;
+#else
+    // A client hanging up mid-response must not take the service down
+    std::signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Error: Socket path is too long." << std::endl;
+        return 1;
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath.c_str()); // Replace a stale socket left by a previous run
+
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "Error: Could not listen on " << socketPath << "." << std::endl;
+        if (listener >= 0) {
+            close(listener);
+        }
+        return 1;
+    }
+
+    std::cout << "Serving on " << socketPath << std::endl;
+
+    unsigned int workerCount = std::max(1u, std::thread::hardware_concurrency());
+    auto state = std::make_shared<ServiceState>(static_cast<int>(workerCount), memoryBudget);
+
+    // Report queue depth, wait times and memory use while there is traffic
+    std::thread([state]() {
+        uint64_t reportedJobs = 0;
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::seconds(10));
+            uint64_t submittedJobs = state->scheduler.jobsSubmitted();
+            if (submittedJobs != reportedJobs) {
+                state->scheduler.printMetrics(std::cout);
+                state->budget.printStatistics(std::cout);
+                reportedJobs = submittedJobs;
+            }
+        }
+    }).detach();
+
+    while (true) {
+        int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+
+        std::thread([state, connection]() { serveConnection(connection, state->scheduler, state->budget); }).detach();
+    }
+
+    std::cerr << "Error: Accepting connections failed." << std::endl;
+    close(listener);
+    return 1;
+#endif
+}
+
+int runServiceBenchmark(const std::string& socketPath, const std::string& imagePath, int iterations) {
+#ifdef _WIN32
+    (void)socketPath;
+    (void)imagePath;
+    (void)iterations;
+    std::cerr << "Error: Service mode needs Unix domain sockets with descriptor passing." << std::endl;
+    return 1;
+#else
+    cv::Mat image = cv::imread(imagePath, cv::IMREAD_UNCHANGED);
+    if (image.empty() || image.depth() != CV_8U) {
+        std::cerr << "Error: Could not open or find the image." << std::endl;
+        return 1;
+    }
+
+    // The wire format carries color in RGB order like the raw inputs
+    if (image.channels() == 3) {
+        cv::cvtColor(image, image, cv::COLOR_BGR2RGB);
+    }
+    else if (image.channels() == 4) {
+        cv::cvtColor(image, image, cv::COLOR_BGRA2RGBA);
+    }
+
+    int connection = connectToService(socketPath);
+    if (connection < 0) {
+        return 1;
+    }
+
+    size_t pixelBytes = image.total() * image.elemSize();
+    size_t outputSamples = static_cast<size_t>(image.cols) * SynthesisSettings().samplesPerRow;
+
+    // A producer using shared memory would decode straight into the segment, so it is filled only once
+    int inputSegment = createSharedMemory(pixelBytes);
+    int outputSegment = createSharedMemory(outputSamples * sizeof(short));
+    void* inputMapping = inputSegment >= 0 ? mmap(nullptr, pixelBytes, PROT_READ | PROT_WRITE, MAP_SHARED, inputSegment, 0) : MAP_FAILED;
+    void* outputMapping = outputSegment >= 0 ? mmap(nullptr, outputSamples * sizeof(short), PROT_READ, MAP_SHARED, outputSegment, 0) : MAP_FAILED;
+
+    if (inputMapping == MAP_FAILED || outputMapping == MAP_FAILED) {
+        std::cerr << "Error: Could not create shared memory segments." << std::endl;
+        close(connection);
+        return 1;
+    }
+
+    cv::Mat segmentImage(image.rows, image.cols, image.type(), inputMapping);
+    image.copyTo(segmentImage);
+
+    std::vector<short> copiedSamples(outputSamples);
+    bool failed = false;
+
+#ifdef __linux__
+    const uint32_t transports[] = { CopyTransport, SharedMemoryTransport };
+#else
+    // The service only maps sealed segments, which need Linux
+    const uint32_t transports[] = { CopyTransport };
+#endif
+
+    for (uint32_t transport : transports) {
+        double totalSeconds = 0.0;
+        double renderSeconds = 0.0;
+        size_t bytesMoved = 0;
+
+        for (int iteration = 0; iteration < iterations && !failed; ++iteration) {
+            ServiceRequest request = { serviceMagic, transport, image.cols, image.rows, image.channels(),
+                static_cast<int32_t>(RenderPriority::Normal), outputSamples };
+            ServiceResponse response = {};
+            auto start = std::chrono::steady_clock::now();
+
+            if (transport == CopyTransport) {
+                failed = !sendAll(connection, &request, sizeof(request))
+                    || !sendAll(connection, image.data, pixelBytes)
+                    || !receiveAll(connection, &response, sizeof(response))
+                    || response.status != StatusOk
+                    || !receiveAll(connection, copiedSamples.data(), response.sampleCount * sizeof(short));
+            }
+            else {
+                int descriptors[2] = { inputSegment, outputSegment };
+                failed = !sendWithDescriptors(connection, &request, sizeof(request), descriptors, 2)
+                    || !receiveAll(connection, &response, sizeof(response))
+                    || response.status != StatusOk;
+            }
+
+            totalSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            renderSeconds += static_cast<double>(response.renderMicroseconds) / 1e6;
+            bytesMoved += pixelBytes + response.sampleCount * sizeof(short);
+        }
+
+        if (failed) {
+            std::cerr << "Error: Service request failed." << std::endl;
+            break;
+        }
+
+        // Everything outside the render itself is the cost of moving the data
+        double transportSeconds = std::max(totalSeconds - renderSeconds, 1e-9);
+        std::cout << (transport == CopyTransport ? "Copy transport: " : "Shared memory transport: ")
+            << std::fixed << std::setprecision(3)
+            << totalSeconds * 1000.0 / iterations << " ms per request, "
+            << transportSeconds * 1000.0 / iterations << " ms transport, "
+            << static_cast<double>(bytesMoved) / (1024.0 * 1024.0) / transportSeconds << " MB/s" << std::endl;
+    }
+
+    munmap(inputMapping, pixelBytes);
+    munmap(outputMapping, outputSamples * sizeof(short));
+    close(inputSegment);
+    close(outputSegment);
+    close(connection);
+    return failed ? 1 : 0;
+#endif
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <memory_resource>
+#include <ostream>
+#include <utility>
+#include <opencv2/opencv.hpp>
+#include <sndfile.h>
+
+// Synthesis parameters shared by still images and frame streams
+struct SynthesisSettings {
+    int sampleRate = 44100;
+    int samplesPerRow = 44100 / 10; // Reduce the number of samples per row to shorten the duration
+    double minFrequency = 200.0; // in Hz
+    double maxFrequency = 8000.0; // in Hz
+    int channels = 1; // Interleaved output channels; samplesPerRow counts frames
+};
+
+// WAV output that drops leading silence as it writes and truncates trailing silence on close
+struct WavStream {
+    SNDFILE* file = nullptr;
+    int channels = 1;
+    sf_count_t framesWritten = 0;
+    sf_count_t audibleFrames = 0; // Frames up to and including the last non-silent sample
+};
+
+// Buffers of a huge page or more are mapped directly and, with --huge-pages, backed by huge pages
+void* allocateLargeBuffer(size_t bytes);
+void freeLargeBuffer(void* buffer, size_t bytes);
+
+// Allocator that leaves elements uninitialized, so the first thread to write a page decides which
+// NUMA node backs it rather than the thread that allocated the buffer
+template <typename T>
+struct FirstTouchAllocator : std::allocator<T> {
+    template <typename U>
+    struct rebind {
+        using other = FirstTouchAllocator<U>;
+    };
+
+    FirstTouchAllocator() = default;
+    template <typename U>
+    FirstTouchAllocator(const FirstTouchAllocator<U>&) {}
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(allocateLargeBuffer(count * sizeof(T)));
+    }
+    void deallocate(T* pointer, size_t count) {
+        freeLargeBuffer(pointer, count * sizeof(T));
+    }
+
+    template <typename U>
+    void construct(U* pointer) {
+        ::new (static_cast<void*>(pointer)) U;
+    }
+    template <typename U, typename... Args>
+    void construct(U* pointer, Args&&... args) {
+        ::new (static_cast<void*>(pointer)) U(std::forward<Args>(args)...);
+    }
+};
+
+// Rendered samples, filled in by whichever workers render the rows
+using SampleBuffer = std::vector<short, FirstTouchAllocator<short>>;
+
+// Backend used to decode still PNG images
+enum class PngDecoder {
+    OpenCV,
+    Spng
+};
+
+// Output channels of a still image: gray as mono, gray panned by hue as stereo, or one channel per color
+enum class ColorMode {
+    Mono,
+    Stereo,
+    Rgb
+};
+
+// Output level of a still image: hard clipping as before, peak normalized from the analytic row
+// bounds, or normalized to a loudness with a lookahead limiter catching the peaks
+enum class NormalizeMode {
+    None,
+    Peak,
+    Loudness
+};
+
+// How still images are decoded before preprocessing
+struct DecodeOptions {
+    int targetOscillators = 0; // 0 keeps one oscillator per image row
+    PngDecoder pngDecoder = PngDecoder::OpenCV;
+    cv::Size rawSize; // Dimensions of headerless .rgba/.ga inputs
+    bool keepColor = false; // JPEGs otherwise decode straight to grayscale
+    bool verbose = false; // Report the decoder and its throughput for every image
+};
+
+// Read-only memory mapping of an input file, unmapped when it goes out of scope
+struct MappedFile {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+};
+
+// Linear model of synthesis time, calibrated from the predicted vs. actual times batch mode prints
+struct CostModel {
+    double nanosecondsPerTap = 12.0; // One oscillator evaluated for one sample
+    double nanosecondsPerSample = 4.0; // Per-sample overhead of clamping and conversion
+};
+
+// Work a render needs, counted after preprocessing
+struct RenderCost {
+    long long rows = 0;
+    long long activeColumns = 0; // Non-black pixels summed over all rows
+    int samplesPerRow = 0;
+
+    double predictedSeconds(const CostModel& model) const {
+        double taps = static_cast<double>(activeColumns) * samplesPerRow;
+        double samples = static_cast<double>(rows) * samplesPerRow;
+        return (taps * model.nanosecondsPerTap + samples * model.nanosecondsPerSample) * 1e-9;
+    }
+};
+
+// Progress of a streamed render, saved periodically so an interrupted render can resume where it
+// stopped; the image hash and settings tie it to the render it came from
+struct RenderCheckpoint {
+    int rows = 0;
+    int cols = 0;
+    uint64_t planesHash = 0;
+    int sampleRate = 0;
+    int samplesPerRow = 0;
+    double minFrequency = 0.0;
+    double maxFrequency = 0.0;
+    int nextRow = 0; // First row not yet written
+    sf_count_t framesWritten = 0;
+    sf_count_t audibleFrames = 0;
+};
+
+// Worker count, memory limit and cost model for batch conversions
+struct BatchOptions {
+    int jobs = 0; // 0 uses one worker per hardware thread
+    size_t memoryBudget = 0; // Bytes, 0 for unlimited
+    CostModel costModel;
+    bool asyncOutput = false; // Hand finished renders to a background writer instead of writing in the worker
+};
+
+// Memory cap of the out-of-core and frequency-major modes when no --memory-budget is given
+const size_t defaultMemoryBudget = size_t(1) << 30;
+
+// Values to combine in a parameter sweep; each list defaults to the standard setting
+struct SweepOptions {
+    std::vector<double> minFrequencies = { SynthesisSettings().minFrequency };
+    std::vector<double> maxFrequencies = { SynthesisSettings().maxFrequency };
+    std::vector<double> rowMilliseconds = { 1000.0 * SynthesisSettings().samplesPerRow / SynthesisSettings().sampleRate };
+    std::vector<int> sampleRates = { SynthesisSettings().sampleRate };
+    bool enabled = false;
+};
+
+// Per-layer gain and start time for a mixdown; empty lists leave every layer at gain 1 and time 0
+struct MixOptions {
+    std::vector<double> gains;
+    std::vector<double> offsetMilliseconds; // Rounded to whole rows of samplesPerRow
+    bool enabled = false;
+};
+
+// Source of frames for animated, video and numbered sequence inputs
+struct FrameReader {
+    cv::VideoCapture capture;
+    std::string sequencePattern; // printf-style pattern such as frame_%04d.png, empty for video
+    int sequenceIndex = 0;
+};
+
+// Alpha row to synthesize with; opaque images have no alpha plane and give nullptr
+inline const uchar* alphaRowOf(const cv::Mat& alphaChannel, int row) {
+    return alphaChannel.empty() ? nullptr : alphaChannel.ptr<uchar>(row);
+}
+
+struct spng_ctx;
+
+// Function prototypes
+cv::Mat processImage(const std::string& filePath, cv::Mat& alphaChannel, const DecodeOptions& options);
+cv::Mat decodeInput(const std::string& filePath, const DecodeOptions& options, MappedFile& mappedFile, bool& rgbOrder);
+cv::Mat decodeImage(const std::string& filePath, const DecodeOptions& options, bool& rgbOrder);
+cv::Mat decodePngWithSpng(const std::string& filePath);
+bool chooseSpngFormat(spng_ctx* context, int& format, int& type, int& flags);
+bool readImageSize(const std::string& filePath, cv::Size& size);
+cv::Mat resizeToOscillators(const cv::Mat& image, int targetOscillators);
+bool isRawImage(const std::string& filePath);
+cv::Mat mapRawImage(const std::string& filePath, cv::Size rawSize, MappedFile& mappedFile, bool& rgbOrder);
+bool mapFile(MappedFile& mappedFile, const std::string& filePath);
+void unmapFile(MappedFile& mappedFile);
+std::string lowercaseExtension(const std::string& filePath);
+cv::Mat preprocessFrame(const cv::Mat& image, cv::Mat& alphaChannel, bool rgbOrder = false);
+cv::Mat splitGrayAlpha(const cv::Mat& image, cv::Mat& alphaChannel, bool rgbOrder = false);
+cv::Mat orientPlane(const cv::Mat& plane);
+bool isStillImage(const std::string& filePath);
+bool isFrameStream(const std::string& filePath);
+bool isAnimatedPng(const std::string& filePath);
+bool openFrameReader(FrameReader& reader, const std::string& inputPath);
+bool readNextFrame(FrameReader& reader, cv::Mat& frame);
+bool generateWavFile(const std::string& outputFilePath, const cv::Mat& image, const cv::Mat& alphaChannel, bool showProgress = true, bool resume = false);
+bool generateIncrementalWav(const std::string& outputFilePath, const cv::Mat& image, const cv::Mat& alphaChannel, const BatchOptions& batchOptions);
+bool generateNormalizedWav(const std::string& outputFilePath, const cv::Mat& image, const cv::Mat& alphaChannel, NormalizeMode mode);
+double normalizationGain(const cv::Mat& image, const cv::Mat& alphaChannel, NormalizeMode mode);
+bool generateOutOfCoreWav(const std::string& outputFilePath, const std::string& inputPath, const DecodeOptions& options, const BatchOptions& batchOptions);
+bool generateFrequencyMajorWav(const std::string& outputFilePath, const std::string& inputPath, const DecodeOptions& options, const BatchOptions& batchOptions);
+bool generateColorWavFile(const std::string& outputFilePath, const std::string& inputPath, const DecodeOptions& decodeOptions, ColorMode mode,
+    const BatchOptions& batchOptions);
+bool generateWavFromFrames(const std::string& outputFilePath, const std::string& inputPath, const DecodeOptions& options);
+void synthesizeRow(const uchar* intensityRow, const uchar* alphaRow, int cols, long long firstSample, const SynthesisSettings& settings, short* output,
+    std::pmr::memory_resource* scratch = std::pmr::get_default_resource());
+void gatherOscillators(const uchar* intensityRow, const uchar* alphaRow, int cols, const SynthesisSettings& settings,
+    std::pmr::vector<double>& frequencies, std::pmr::vector<double>& amplitudes);
+double columnFrequency(int col, int cols, const SynthesisSettings& settings);
+double pixelAmplitude(uchar intensityValue, uchar alphaValue);
+double opaqueAmplitude(uchar intensityValue);
+void synthesizeOscillators(const double* frequencies, const double* amplitudes, size_t count, long long firstSample, const SynthesisSettings& settings, short* output);
+bool openWavStream(WavStream& stream, const std::string& filePath, const SynthesisSettings& settings);
+void writeWavStream(WavStream& stream, const short* samples, size_t count);
+void closeWavStream(WavStream& stream);
+bool resumeWavStream(WavStream& stream, const std::string& filePath, const SynthesisSettings& settings, const RenderCheckpoint& checkpoint);
+void syncWavStream(WavStream& stream);
+bool readCheckpoint(const std::string& checkpointPath, RenderCheckpoint& checkpoint);
+bool writeCheckpoint(const std::string& checkpointPath, const RenderCheckpoint& checkpoint);
+uint64_t hashBytes(const unsigned char* data, size_t size, uint64_t hash = 1469598103934665603ULL);
+uint64_t hashImagePlanes(const cv::Mat& image, const cv::Mat& alphaChannel);
+void renderRows(const cv::Mat& image, const cv::Mat& alphaChannel, int firstRow, int rowCount, const SynthesisSettings& settings, short* output,
+    std::pmr::memory_resource* scratch = std::pmr::get_default_resource());
+void findAudibleRange(const short* samples, size_t count, size_t& begin, size_t& end);
+std::string outputPathFor(const std::string& inputPath);
+size_t parseByteSize(const std::string& text);
+size_t estimateJobMemory(cv::Size imageSize, int channels, const SynthesisSettings& settings, bool bufferedOutput);
+RenderCost estimateRenderCost(const cv::Mat& image, const SynthesisSettings& settings);
+bool writeWavFile(const std::string& outputFilePath, const short* samples, size_t count, const SynthesisSettings& settings);
+int runBatch(const std::vector<std::string>& inputPaths, const DecodeOptions& decodeOptions, const BatchOptions& batchOptions);
+int runService(const std::string& socketPath, size_t memoryBudget);
+int runServiceBenchmark(const std::string& socketPath, const std::string& imagePath, int iterations);
+void setHugePages(bool enabled);
+void printHugePageStatistics(std::ostream& out);
+int runHugePageBenchmark(const std::string& imagePath, const DecodeOptions& options, int iterations);
+int runSweep(const std::string& inputPath, const DecodeOptions& decodeOptions, const BatchOptions& batchOptions, const SweepOptions& sweepOptions);
+int runMix(const std::vector<std::string>& inputPaths, const DecodeOptions& decodeOptions, const BatchOptions& batchOptions, const MixOptions& mixOptions);
+std::vector<double> parseNumberList(const std::string& text, bool allowZero = false);
+int runWatch(const std::string& watchDirectory, const std::string& outputDirectory, const DecodeOptions& decodeOptions, const BatchOptions& batchOptions);
@@ -0,0 +1,42 @@
+#pragma once
+
+// C interface to the renderer for use from other languages, such as the Python bindings in
+// python/soundcanvas.py. Build the sources as a shared library to use it.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#define SOUNDCANVAS_API __declspec(dllexport)
+#else
+#define SOUNDCANVAS_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Preprocessed gray and alpha planes of one image, ready to render
+typedef struct SoundCanvasImage SoundCanvasImage;
+
+// Preprocesses 8-bit pixels with 1 to 4 channels in gray, gray+alpha, RGB or RGBA order. The pixels
+// are read in place and not kept after the call; rowStride is the distance between rows in bytes.
+// Returns NULL on failure
+SOUNDCANVAS_API SoundCanvasImage* soundcanvas_prepare(const uint8_t* pixels, int width, int height, int channels, size_t rowStride);
+SOUNDCANVAS_API void soundcanvas_release(SoundCanvasImage* image);
+
+// Audio rows, one per image column, each holding soundcanvas_samples_per_row() samples
+SOUNDCANVAS_API int soundcanvas_rows(const SoundCanvasImage* image);
+SOUNDCANVAS_API int soundcanvas_samples_per_row(void);
+SOUNDCANVAS_API int soundcanvas_sample_rate(void);
+
+// Renders rows [firstRow, firstRow + rowCount) into output, which must hold rowCount rows of samples.
+// Safe to call from several threads at once on the same image. Returns 0 on success
+SOUNDCANVAS_API int soundcanvas_render_rows(const SoundCanvasImage* image, int firstRow, int rowCount, int16_t* output);
+
+// Range of samples between the leading and trailing silence, which is what WAV output keeps
+SOUNDCANVAS_API void soundcanvas_audible_range(const int16_t* samples, size_t count, size_t* begin, size_t* end);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,128 @@
+#include "StripeReader.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if __has_include(<spng.h>)
+#include <spng.h>
+#define SOUNDCANVAS_HAS_SPNG 1
+#else
+#define SOUNDCANVAS_HAS_SPNG 0
+#endif
+
+StripeReader::~StripeReader() {
+#if SOUNDCANVAS_HAS_SPNG
+    if (context) {
+        spng_ctx_free(context);
+    }
+#endif
+    if (file) {
+        std::fclose(file);
+    }
+}
+
+bool StripeReader::open(const std::string& filePath, const DecodeOptions& options) {
+    if (isRawImage(filePath)) {
+        image = mapRawImage(filePath, options.rawSize, mappedFile, rgbOrder);
+        return setSize(image.cols, image.rows);
+    }
+
+    if (lowercaseExtension(filePath) == ".png" && openPng(filePath)) {
+        return true;
+    }
+
+    std::cout << "No row-wise decoder for " << filePath << "; it is decoded whole." << std::endl;
+    image = decodeImage(filePath, options, rgbOrder);
+    return setSize(image.cols, image.rows);
+}
+
+cv::Mat StripeReader::read(int rowCount) {
+    int firstRow = nextRow;
+    nextRow += rowCount;
+    if (!image.empty()) {
+        // The previous stripe is no longer valid, so a mapped input lets go of it before the next
+        // one is faulted in; otherwise the whole file ends up resident by the last stripe
+        if (mappedFile.data) {
+            releaseMappedRows(firstRow);
+        }
+        return image.rowRange(firstRow, nextRow);
+    }
+
+#if SOUNDCANVAS_HAS_SPNG
+    stripe.create(rowCount, width, stripeType);
+    for (int row = 0; row < rowCount; ++row) {
+        int result = spng_decode_row(context, stripe.ptr<uchar>(row), stripe.cols * stripe.elemSize());
+        if (result != 0 && !(result == SPNG_EOI && firstRow + row == height - 1)) {
+            std::cerr << "Error: Could not decode row " << firstRow + row << " of the PNG." << std::endl;
+            return cv::Mat();
+        }
+    }
+#endif
+    return stripe;
+}
+
+void StripeReader::releaseMappedRows(int endRow) {
+#ifdef _WIN32
+    const size_t pageSize = 4096;
+#else
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+
+    // Only whole pages before endRow, so the rows still to be read are never affected
+    size_t end = static_cast<size_t>(image.data + static_cast<size_t>(endRow) * image.step - mappedFile.data) / pageSize * pageSize;
+    if (end <= releasedBytes) {
+        return;
+    }
+
+    unsigned char* begin = const_cast<unsigned char*>(mappedFile.data) + releasedBytes;
+#ifdef _WIN32
+    // Unlocking pages that were never locked removes them from the working set
+    VirtualUnlock(begin, end - releasedBytes);
+#else
+    madvise(begin, end - releasedBytes, MADV_DONTNEED);
+#endif
+    releasedBytes = end;
+}
+
+bool StripeReader::setSize(int imageWidth, int imageHeight) {
+    width = imageWidth;
+    height = imageHeight;
+    return width > 0 && height > 0;
+}
+
+bool StripeReader::openPng(const std::string& filePath) {
+#if SOUNDCANVAS_HAS_SPNG
+    file = std::fopen(filePath.c_str(), "rb");
+    context = file ? spng_ctx_new(0) : nullptr;
+    spng_ihdr ihdr;
+    if (!context || spng_set_png_file(context, file) != 0 || spng_get_ihdr(context, &ihdr) != 0) {
+        return false;
+    }
+
+    // Interlaced rows arrive over several passes, so those take the whole-image path
+    if (ihdr.interlace_method != 0) {
+        return false;
+    }
+
+    // Same output formats as decodePngWithSpng, so opaque images have no alpha plane
+    int format = 0;
+    int flags = 0;
+    if (!chooseSpngFormat(context, format, stripeType, flags)
+        || spng_decode_image(context, nullptr, 0, format, SPNG_DECODE_PROGRESSIVE | flags) != 0) {
+        return false;
+    }
+    rgbOrder = true;
+    return setSize(static_cast<int>(ihdr.width), static_cast<int>(ihdr.height));
+#else
+    (void)filePath;
+    return false;
+#endif
+}
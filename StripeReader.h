@@ -0,0 +1,43 @@
+#pragma once
+
+#include "SoundCanvas.h"
+
+#include <cstdio>
+#include <string>
+
+struct spng_ctx;
+
+// Input image read top to bottom a stripe of rows at a time. Raw images are read through their
+// mapping and non-interlaced PNGs are decoded row by row with libspng; other formats have no
+// row-wise decoder here and are decoded whole
+class StripeReader {
+public:
+    StripeReader() = default;
+    ~StripeReader();
+
+    StripeReader(const StripeReader&) = delete;
+    StripeReader& operator=(const StripeReader&) = delete;
+
+    bool open(const std::string& filePath, const DecodeOptions& options);
+
+    // Next rowCount rows in decoder order, valid until the next call; empty on a decode error
+    cv::Mat read(int rowCount);
+
+    int width = 0;
+    int height = 0;
+    bool rgbOrder = false;
+
+private:
+    bool setSize(int imageWidth, int imageHeight);
+    bool openPng(const std::string& filePath);
+    void releaseMappedRows(int endRow);
+
+    std::FILE* file = nullptr;
+    spng_ctx* context = nullptr;
+    int stripeType = CV_8UC4;
+    MappedFile mappedFile;
+    cv::Mat image; // Whole image for mapped and fully decoded inputs
+    cv::Mat stripe;
+    int nextRow = 0;
+    size_t releasedBytes = 0; // Start of the mapping already dropped from memory
+};
@@ -0,0 +1,122 @@
+#include "SoundCanvas.h"
+#include "Scheduler.h"
+
+#include <iostream>
+#include <iomanip>
+#include <filesystem>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Output name that spells out the combination, e.g. image_200-8000Hz_100ms_44100.wav
+std::string sweepOutputPath(const std::string& inputPath, const SynthesisSettings& settings, double rowMilliseconds) {
+    std::string basePath = outputPathFor(inputPath);
+    std::ostringstream name;
+    name << std::filesystem::path(basePath).stem().string() << '_' << settings.minFrequency << '-' << settings.maxFrequency
+        << "Hz_" << rowMilliseconds << "ms_" << settings.sampleRate << ".wav";
+    return name.str();
+}
+
+} // namespace
+
+int runSweep(const std::string& inputPath, const DecodeOptions& decodeOptions, const BatchOptions& batchOptions, const SweepOptions& sweepOptions) {
+    // Every combination reads the same planes; cv::Mat shares them between jobs without copying
+    auto preprocessStart = std::chrono::steady_clock::now();
+    cv::Mat alphaChannel;
+    cv::Mat processedImage = processImage(inputPath, alphaChannel, decodeOptions);
+    if (processedImage.empty()) {
+        return 1;
+    }
+    double preprocessSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - preprocessStart).count();
+
+    struct Combination {
+        SynthesisSettings settings;
+        double rowMilliseconds;
+    };
+
+    std::vector<Combination> combinations;
+    for (int sampleRate : sweepOptions.sampleRates) {
+        for (double rowMilliseconds : sweepOptions.rowMilliseconds) {
+            for (double minFrequency : sweepOptions.minFrequencies) {
+                for (double maxFrequency : sweepOptions.maxFrequencies) {
+                    Combination combination;
+                    combination.settings.sampleRate = sampleRate;
+                    combination.settings.samplesPerRow = std::max(1, static_cast<int>(sampleRate * rowMilliseconds / 1000.0 + 0.5));
+                    combination.settings.minFrequency = minFrequency;
+                    combination.settings.maxFrequency = maxFrequency;
+                    combination.rowMilliseconds = rowMilliseconds;
+
+                    // Frequencies past Nyquist alias back down, which is never what a sweep is after
+                    if (minFrequency >= maxFrequency || maxFrequency >= sampleRate / 2.0) {
+                        std::cerr << "Error: Skipping " << minFrequency << "-" << maxFrequency << " Hz at " << sampleRate
+                            << " Hz; the range must be increasing and below half the sample rate." << std::endl;
+                        continue;
+                    }
+                    combinations.push_back(combination);
+                }
+            }
+        }
+    }
+
+    if (combinations.empty()) {
+        std::cerr << "Error: The sweep has no valid combinations." << std::endl;
+        return 1;
+    }
+
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    int workerCount = batchOptions.jobs > 0 ? batchOptions.jobs : static_cast<int>(hardwareThreads);
+    workerCount = std::min(workerCount, static_cast<int>(combinations.size()));
+    std::cout << "Rendering " << combinations.size() << " combinations with " << workerCount << " workers..." << std::endl;
+
+    // All combinations render concurrently through one pool; workers only hold output memory
+    RenderScheduler scheduler(static_cast<int>(hardwareThreads));
+    MemoryBudget budget(batchOptions.memoryBudget);
+    std::mutex outputMutex;
+    std::atomic<size_t> nextCombination{ 0 };
+    std::atomic<int> failures{ 0 };
+    auto sweepStart = std::chrono::steady_clock::now();
+
+    auto worker = [&]() {
+        for (size_t index = nextCombination++; index < combinations.size(); index = nextCombination++) {
+            const Combination& combination = combinations[index];
+            size_t sampleCount = static_cast<size_t>(processedImage.rows) * combination.settings.samplesPerRow;
+            MemoryReservation reservation(budget, sampleCount * sizeof(short));
+
+            std::shared_ptr<RenderJob> job = scheduler.submit(processedImage, alphaChannel, combination.settings, RenderPriority::Normal);
+            scheduler.wait(job);
+
+            std::string outputPath = sweepOutputPath(inputPath, combination.settings, combination.rowMilliseconds);
+            if (!writeWavFile(outputPath, job->output, sampleCount, combination.settings)) {
+                failures++;
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(outputMutex);
+            std::cout << "File Output: " << outputPath << " (render " << std::fixed << std::setprecision(3) << job->renderSeconds << " s)" << std::endl;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < workerCount; ++i) {
+        workers.emplace_back(worker);
+    }
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+
+    double sweepSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - sweepStart).count();
+    std::cout << "Sweep finished in " << std::fixed << std::setprecision(3) << sweepSeconds << " s after one decode and preprocess of "
+        << preprocessSeconds << " s, instead of " << combinations.size() << "." << std::endl;
+
+    if (failures > 0) {
+        std::cerr << "Error: " << failures << " of " << combinations.size() << " combinations failed." << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,189 @@
+#include "Batch.h"
+
+#include <iostream>
+#include <iomanip>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+namespace {
+
+// A finished input waiting for a worker, stamped when its close was reported
+struct WatchedFile {
+    std::string path;
+    std::chrono::steady_clock::time_point closedAt;
+};
+
+// End-to-end latency from file close to WAV complete over the life of the watcher
+struct WatchStatistics {
+    std::mutex mutex;
+    uint64_t converted = 0;
+    uint64_t failed = 0;
+    double totalLatencySeconds = 0.0;
+    double maxLatencySeconds = 0.0;
+};
+
+} // namespace
+#endif
+
+int runWatch(const std::string& watchDirectory, const std::string& outputDirectory, const DecodeOptions& decodeOptions, const BatchOptions& batchOptions) {
+#ifndef __linux__
+    (void)watchDirectory;
+    (void)outputDirectory;
+    (void)decodeOptions;
+    (void)batchOptions;
+    std::cerr << "Error: Watch mode needs inotify, which is only available on Linux." << std::endl;
+    return 1;
+#else
+    std::error_code error;
+    std::filesystem::create_directories(outputDirectory, error);
+    if (error) {
+        std::cerr << "Error: Could not create output directory " << outputDirectory << "." << std::endl;
+        return 1;
+    }
+
+    int notifier = inotify_init1(IN_CLOEXEC);
+    // Close-write catches files written in place, moved-to catches files renamed in after writing
+    if (notifier < 0 || inotify_add_watch(notifier, watchDirectory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        std::cerr << "Error: Could not watch " << watchDirectory << "." << std::endl;
+        if (notifier >= 0) {
+            close(notifier);
+        }
+        return 1;
+    }
+
+    // The scheduler, budget and workers stay up between files, so each one only pays for its own
+    // work. A rewritten input replaces its output, so an earlier output never stands in for it
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    int workerCount = batchOptions.jobs > 0 ? batchOptions.jobs : static_cast<int>(hardwareThreads);
+    ConversionContext context(decodeOptions, batchOptions, false);
+    WatchStatistics statistics;
+
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::deque<WatchedFile> pending;
+    bool stopping = false;
+    size_t nextId = 0;
+
+    auto recordResult = [&statistics](const std::string& outputPath, std::chrono::steady_clock::time_point closedAt, bool converted) {
+        double latencySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - closedAt).count();
+
+        std::lock_guard<std::mutex> lock(statistics.mutex);
+        if (!converted) {
+            statistics.failed++;
+            return;
+        }
+
+        statistics.converted++;
+        statistics.totalLatencySeconds += latencySeconds;
+        statistics.maxLatencySeconds = std::max(statistics.maxLatencySeconds, latencySeconds);
+        std::cout << "File Output: " << outputPath << " (" << std::fixed << std::setprecision(1) << latencySeconds * 1000.0
+            << " ms after close, " << statistics.totalLatencySeconds * 1000.0 / statistics.converted << " ms avg, "
+            << statistics.maxLatencySeconds * 1000.0 << " ms max over " << statistics.converted << " files)" << std::endl;
+    };
+
+    // Workers finish what is queued once stopping is set, then exit
+    auto worker = [&]() {
+        ConversionWorker conversionWorker(context);
+        while (true) {
+            WatchedFile file;
+            size_t id = 0;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueChanged.wait(lock, [&]() { return stopping || !pending.empty(); });
+                if (pending.empty()) {
+                    return;
+                }
+                file = pending.front();
+                pending.pop_front();
+                id = nextId++;
+            }
+
+            // Latency runs to the WAV being complete, which with --async-output is on the writer thread
+            std::string outputPath = (std::filesystem::path(outputDirectory) / outputPathFor(file.path)).string();
+            ConversionOutcome outcome = convertStillImage(conversionWorker, id, file.path, outputPath,
+                [&recordResult, outputPath, closedAt = file.closedAt](bool written) { recordResult(outputPath, closedAt, written); });
+            if (outcome.result == ConversionResult::Failed) {
+                recordResult(outputPath, file.closedAt, false);
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < workerCount; ++i) {
+        workers.emplace_back(worker);
+    }
+
+    std::cout << "Watching " << watchDirectory << ", writing to " << outputDirectory << std::endl;
+
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (true) {
+        ssize_t length = read(notifier, buffer, sizeof(buffer));
+        if (length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        // inotify events carry no time, so latency is measured from when the event is read,
+        // which trails the close by the time it takes to wake this thread
+        auto closedAt = std::chrono::steady_clock::now();
+        std::vector<WatchedFile> files;
+
+        for (ssize_t offset = 0; offset < length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                std::cerr << "Error: Watch events were dropped; files written during the overflow are not converted." << std::endl;
+                continue;
+            }
+
+            // Hidden files are usually partial uploads that get renamed once complete
+            if (event->len == 0 || event->name[0] == '.' || (event->mask & IN_ISDIR)) {
+                continue;
+            }
+
+            std::string path = (std::filesystem::path(watchDirectory) / event->name).string();
+            if (isStillImage(path)) {
+                files.push_back({ path, closedAt });
+            }
+        }
+
+        if (!files.empty()) {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            pending.insert(pending.end(), files.begin(), files.end());
+            queueChanged.notify_all();
+        }
+    }
+
+    std::cerr << "Error: Reading watch events failed." << std::endl;
+    close(notifier);
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+        queueChanged.notify_all();
+    }
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+    if (context.writer) {
+        context.writer->finish();
+    }
+    return 1;
+#endif
+}
@@ -6,88 +6,830 @@
 #include <cmath>
 #include <vector>
 #include <iomanip>
+#include <algorithm>
+#include <fstream>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdio>
+#include <cctype>
+#include <cstdlib>
+#include <chrono>
+#include <sstream>
 
-// Function prototypes
-cv::Mat processImage(const std::string& filePath, cv::Mat& alphaChannel);
-void generateWavFile(const std::string& outputFilePath, const cv::Mat& image, const cv::Mat& alphaChannel);
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
+// libspng is used as an optional faster PNG decoder when it is available
+#if __has_include(<spng.h>)
+#include <spng.h>
+#define SOUNDCANVAS_HAS_SPNG 1
+#ifdef _MSC_VER
+#pragma comment(lib, "spng.lib")
+#endif
+#else
+#define SOUNDCANVAS_HAS_SPNG 0
+#endif
+
+#include "SoundCanvas.h"
+#include "Arena.h"
+
+// Samples quieter than this are trimmed from the start and end of the output
+const short silenceThreshold = 500;
+
+// The test executable links these sources with its own entry point
+#ifndef SOUNDCANVAS_NO_MAIN
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <image_file>" << std::endl;
+    std::vector<std::string> inputPaths;
+    DecodeOptions decodeOptions;
+    BatchOptions batchOptions;
+    std::string serviceSocketPath;
+    std::string benchmarkSocketPath;
+    bool benchmarkHugePages = false;
+    bool resume = false;
+    bool incremental = false;
+    bool outOfCore = false;
+    bool frequencyMajor = false;
+    SweepOptions sweepOptions;
+    MixOptions mixOptions;
+    ColorMode colorMode = ColorMode::Mono;
+    NormalizeMode normalizeMode = NormalizeMode::None;
+    std::string watchDirectory;
+    std::string outputDirectory = ".";
+    int benchmarkIterations = 10;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "--oscillators" && i + 1 < argc) {
+            decodeOptions.targetOscillators = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (argument == "--decoder" && i + 1 < argc) {
+            std::string decoderName = argv[++i];
+            if (decoderName == "spng" && SOUNDCANVAS_HAS_SPNG) {
+                decodeOptions.pngDecoder = PngDecoder::Spng;
+            }
+            else if (decoderName != "opencv") {
+                std::cerr << "Error: Unknown or unavailable PNG decoder " << decoderName << "." << std::endl;
+                return 1;
+            }
+        }
+        else if (argument == "--size" && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%dx%d", &decodeOptions.rawSize.width, &decodeOptions.rawSize.height) != 2) {
+                std::cerr << "Error: --size expects WIDTHxHEIGHT." << std::endl;
+                return 1;
+            }
+        }
+        else if (argument == "--serve" && i + 1 < argc) {
+            serviceSocketPath = argv[++i];
+        }
+        else if (argument == "--watch" && i + 1 < argc) {
+            watchDirectory = argv[++i];
+        }
+        else if (argument == "--output-dir" && i + 1 < argc) {
+            outputDirectory = argv[++i];
+        }
+        else if (argument == "--bench-service" && i + 1 < argc) {
+            benchmarkSocketPath = argv[++i];
+        }
+        else if (argument == "--verbose") {
+            decodeOptions.verbose = true;
+        }
+        else if (argument == "--resume") {
+            resume = true;
+        }
+        else if (argument == "--incremental") {
+            incremental = true;
+        }
+        else if (argument == "--out-of-core") {
+            outOfCore = true;
+        }
+        else if (argument == "--frequency-major") {
+            frequencyMajor = true;
+        }
+        else if ((argument == "--sweep-min" || argument == "--sweep-max" || argument == "--sweep-row-ms" || argument == "--sweep-rate") && i + 1 < argc) {
+            std::vector<double> values = parseNumberList(argv[++i]);
+            if (values.empty()) {
+                std::cerr << "Error: " << argument << " expects a comma-separated list of numbers." << std::endl;
+                return 1;
+            }
+
+            sweepOptions.enabled = true;
+            if (argument == "--sweep-min") {
+                sweepOptions.minFrequencies = values;
+            }
+            else if (argument == "--sweep-max") {
+                sweepOptions.maxFrequencies = values;
+            }
+            else if (argument == "--sweep-row-ms") {
+                sweepOptions.rowMilliseconds = values;
+            }
+            else {
+                sweepOptions.sampleRates.assign(values.begin(), values.end());
+            }
+        }
+        else if (argument == "--color" && i + 1 < argc) {
+            std::string modeName = argv[++i];
+            if (modeName == "stereo") {
+                colorMode = ColorMode::Stereo;
+            }
+            else if (modeName == "rgb") {
+                colorMode = ColorMode::Rgb;
+            }
+            else if (modeName != "mono") {
+                std::cerr << "Error: --color expects mono, stereo or rgb." << std::endl;
+                return 1;
+            }
+        }
+        else if (argument == "--normalize" && i + 1 < argc) {
+            std::string modeName = argv[++i];
+            if (modeName == "peak") {
+                normalizeMode = NormalizeMode::Peak;
+            }
+            else if (modeName == "loudness") {
+                normalizeMode = NormalizeMode::Loudness;
+            }
+            else {
+                std::cerr << "Error: --normalize expects peak or loudness." << std::endl;
+                return 1;
+            }
+        }
+        else if (argument == "--mix") {
+            mixOptions.enabled = true;
+        }
+        else if ((argument == "--gains" || argument == "--offsets-ms") && i + 1 < argc) {
+            std::vector<double> values = parseNumberList(argv[++i], true);
+            if (values.empty()) {
+                std::cerr << "Error: " << argument << " expects a comma-separated list of numbers." << std::endl;
+                return 1;
+            }
+
+            mixOptions.enabled = true;
+            (argument == "--gains" ? mixOptions.gains : mixOptions.offsetMilliseconds) = values;
+        }
+        else if (argument == "--huge-pages") {
+            setHugePages(true);
+        }
+        else if (argument == "--bench-huge-pages") {
+            benchmarkHugePages = true;
+        }
+        else if (argument == "--iterations" && i + 1 < argc) {
+            benchmarkIterations = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (argument == "--jobs" && i + 1 < argc) {
+            batchOptions.jobs = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (argument == "--memory-budget" && i + 1 < argc) {
+            batchOptions.memoryBudget = parseByteSize(argv[++i]);
+        }
+        else if (argument == "--ns-per-tap" && i + 1 < argc) {
+            batchOptions.costModel.nanosecondsPerTap = std::atof(argv[++i]);
+        }
+        else if (argument == "--async-output") {
+            batchOptions.asyncOutput = true;
+        }
+        else if (argument.rfind("--", 0) != 0) {
+            inputPaths.push_back(argument);
+        }
+        else {
+            inputPaths.clear();
+            break;
+        }
+    }
+
+    // Each of these picks a different way to render, so giving two would silently drop one
+    std::vector<std::string> modes;
+    const std::pair<bool, const char*> modeFlags[] = {
+        { !serviceSocketPath.empty(), "--serve" }, { !watchDirectory.empty(), "--watch" },
+        { !benchmarkSocketPath.empty(), "--bench-service" }, { benchmarkHugePages, "--bench-huge-pages" },
+        { mixOptions.enabled, "--mix" }, { sweepOptions.enabled, "--sweep-*" }, { colorMode != ColorMode::Mono, "--color" },
+        { frequencyMajor, "--frequency-major" }, { outOfCore, "--out-of-core" }, { normalizeMode != NormalizeMode::None, "--normalize" },
+        { incremental, "--incremental" }, { resume, "--resume" },
+    };
+    for (const auto& modeFlag : modeFlags) {
+        if (modeFlag.first) {
+            modes.push_back(modeFlag.second);
+        }
+    }
+    if (modes.size() > 1) {
+        std::cerr << "Error: " << modes[0] << " and " << modes[1] << " cannot be combined." << std::endl;
         return 1;
     }
-    else if (std::string(argv[1]).find(".png") == std::string::npos) { // Check for png extension
-        std::cerr << "Error: " << argv[1] << " is not a PNG image." << std::endl;
+    if (!modes.empty() && !mixOptions.enabled && inputPaths.size() > 1) {
+        std::cerr << "Error: " << modes[0] << " takes a single image; several images are converted as a batch." << std::endl;
         return 1;
     }
 
-    std::cout << "Welcome to SoundCanvas!" << std::endl;
+    // Service mode takes its images from clients instead of the command line
+    if (!serviceSocketPath.empty()) {
+        return runService(serviceSocketPath, batchOptions.memoryBudget);
+    }
+
+    // Watch mode converts files as they are dropped into a directory until it is stopped
+    if (!watchDirectory.empty()) {
+        return runWatch(watchDirectory, outputDirectory, decodeOptions, batchOptions);
+    }
 
-    std::string imageFilePath = argv[1];
-    cv::Mat alphaChannel;
-    cv::Mat processedImage = processImage(imageFilePath, alphaChannel);
+    if (inputPaths.empty() || (inputPaths.size() > 1 && (!benchmarkSocketPath.empty() || benchmarkHugePages || sweepOptions.enabled || colorMode != ColorMode::Mono))) {
+        std::cerr << "Usage: " << argv[0] << " [--oscillators N] [--decoder opencv|spng] [--size WxH] [--verbose] [--jobs N] [--resume | --incremental | --normalize peak|loudness] <image_file | animation | video | frame_%04d.png>" << std::endl;
+        std::cerr << "       " << argv[0] << " --out-of-core | --frequency-major [--jobs N] [--memory-budget BYTES[K|M|G]] <image_file>" << std::endl;
+        std::cerr << "       " << argv[0] << " --color stereo|rgb [--oscillators N] [--jobs N] <image_file>" << std::endl;
+        std::cerr << "       " << argv[0] << " [--jobs N] [--memory-budget BYTES[K|M|G]] [--ns-per-tap NS] [--async-output] <image_file> <image_file>..." << std::endl;
+        std::cerr << "       " << argv[0] << " [--sweep-min HZ,...] [--sweep-max HZ,...] [--sweep-row-ms MS,...] [--sweep-rate HZ,...] [--jobs N] <image_file>" << std::endl;
+        std::cerr << "       " << argv[0] << " --mix [--gains G,...] [--offsets-ms MS,...] [--oscillators N] [--jobs N] <image_file>..." << std::endl;
+        std::cerr << "       " << argv[0] << " --serve <socket> [--memory-budget BYTES[K|M|G]]" << std::endl;
+        std::cerr << "       " << argv[0] << " --watch <directory> [--output-dir <directory>] [--jobs N] [--memory-budget BYTES[K|M|G]]" << std::endl;
+        std::cerr << "       " << argv[0] << " --bench-service <socket> [--iterations N] <image_file>" << std::endl;
+        std::cerr << "       " << argv[0] << " --bench-huge-pages [--iterations N] <image_file>" << std::endl;
+        std::cerr << "Large buffers use 2 MB huge pages with --huge-pages (Linux)." << std::endl;
+        return 1;
+    }
+
+    const std::string& inputPath = inputPaths.front();
+
+    if (!benchmarkSocketPath.empty()) {
+        return runServiceBenchmark(benchmarkSocketPath, inputPath, benchmarkIterations);
+    }
+
+    if (benchmarkHugePages) {
+        return runHugePageBenchmark(inputPath, decodeOptions, benchmarkIterations);
+    }
 
-    if (processedImage.empty() || alphaChannel.empty()) {
+    bool frameStream = isFrameStream(inputPath);
+
+    if (!frameStream && !isStillImage(inputPath)) { // Check for a supported image extension
+        std::cerr << "Error: " << inputPath << " is not a PNG, JPEG, WebP, TIFF or raw image, animation, video or frame sequence." << std::endl;
+        return 1;
+    }
+    if (frameStream && !modes.empty()) {
+        std::cerr << "Error: " << modes[0] << " takes a still image, not an animation, video or frame sequence." << std::endl;
         return 1;
     }
 
-    // Generate output WAV file path
-    std::filesystem::path imagePath(imageFilePath);
-    std::string outputWavFilePath = imagePath.stem().string() + ".wav";
+    std::cout << "Welcome to SoundCanvas!" << std::endl;
+
+    // Mixdowns layer every input into one output instead of converting each on its own
+    if (mixOptions.enabled) {
+        for (const std::string& path : inputPaths) {
+            if (!isStillImage(path)) {
+                std::cerr << "Error: Mixdowns take still images; " << path << " is not one." << std::endl;
+                return 1;
+            }
+        }
+        return runMix(inputPaths, decodeOptions, batchOptions, mixOptions);
+    }
+
+    if (inputPaths.size() > 1) {
+        return runBatch(inputPaths, decodeOptions, batchOptions);
+    }
 
-    generateWavFile(outputWavFilePath, processedImage, alphaChannel);
+    if (sweepOptions.enabled) {
+        return runSweep(inputPath, decodeOptions, batchOptions, sweepOptions);
+    }
+
+    std::string outputWavFilePath = outputPathFor(inputPath);
+
+    // Color output shares each column's oscillator between the channels
+    if (colorMode != ColorMode::Mono) {
+        if (!generateColorWavFile(outputWavFilePath, inputPath, decodeOptions, colorMode, batchOptions)) {
+            return 1;
+        }
+        std::cout << "File Output: " << outputWavFilePath << std::endl;
+        return 0;
+    }
+
+    if (frameStream) {
+        if (!generateWavFromFrames(outputWavFilePath, inputPath, decodeOptions)) {
+            return 1;
+        }
+    }
+    else if (frequencyMajor) {
+        // Input rows are rendered as they decode, one oscillator across the whole timeline at a time
+        if (!generateFrequencyMajorWav(outputWavFilePath, inputPath, decodeOptions, batchOptions)) {
+            return 1;
+        }
+    }
+    else if (outOfCore) {
+        // Images larger than memory are transposed through a temporary tile file
+        if (!generateOutOfCoreWav(outputWavFilePath, inputPath, decodeOptions, batchOptions)) {
+            return 1;
+        }
+    }
+    else {
+        cv::Mat alphaChannel;
+        cv::Mat processedImage = processImage(inputPath, alphaChannel, decodeOptions);
+
+        if (processedImage.empty()) {
+            return 1;
+        }
+
+        // Normalized renders carry limiter state from row to row, so they neither resume nor patch rows;
+        // incremental renders keep a sidecar with the untrimmed render and only redo rows that changed
+        bool generated = false;
+        if (normalizeMode != NormalizeMode::None) {
+            generated = generateNormalizedWav(outputWavFilePath, processedImage, alphaChannel, normalizeMode);
+        }
+        else if (incremental) {
+            generated = generateIncrementalWav(outputWavFilePath, processedImage, alphaChannel, batchOptions);
+        }
+        else {
+            generated = generateWavFile(outputWavFilePath, processedImage, alphaChannel, true, resume);
+        }
+        if (!generated) {
+            return 1;
+        }
+    }
 
     std::cout << "File Output: " << outputWavFilePath << std::endl;
     return 0;
 }
+#endif
 
-cv::Mat processImage(const std::string& filePath, cv::Mat& alphaChannel) {
+std::string outputPathFor(const std::string& inputPath) {
+    // Generate output WAV file path, dropping the frame number placeholder of a sequence pattern
+    std::string stem = std::filesystem::path(inputPath).stem().string();
+    size_t placeholder = stem.find('%');
+    if (placeholder != std::string::npos) {
+        size_t placeholderEnd = stem.find('d', placeholder);
+        stem.erase(placeholder, placeholderEnd == std::string::npos ? std::string::npos : placeholderEnd - placeholder + 1);
+    }
+    return (stem.empty() ? "frames" : stem) + ".wav";
+}
+
+std::vector<double> parseNumberList(const std::string& text, bool allowZero) {
+    std::vector<double> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        char* end = nullptr;
+        double value = std::strtod(item.c_str(), &end);
+        if (item.empty() || *end != '\0' || value < 0.0 || (value == 0.0 && !allowZero)) {
+            return {};
+        }
+        values.push_back(value);
+    }
+    return values;
+}
+
+size_t parseByteSize(const std::string& text) {
+    char* suffix = nullptr;
+    double value = std::strtod(text.c_str(), &suffix);
+    switch (suffix ? std::toupper(static_cast<unsigned char>(*suffix)) : 0) {
+    case 'K':
+        value *= 1024.0;
+        break;
+    case 'M':
+        value *= 1024.0 * 1024.0;
+        break;
+    case 'G':
+        value *= 1024.0 * 1024.0 * 1024.0;
+        break;
+    }
+    return value > 0.0 ? static_cast<size_t>(value) : 0;
+}
+
+RenderCost estimateRenderCost(const cv::Mat& image, const SynthesisSettings& settings) {
+    // Black pixels are skipped by the synthesizer, so only the others cost oscillator evaluations
+    RenderCost cost;
+    cost.rows = image.rows;
+    cost.activeColumns = image.empty() ? 0 : cv::countNonZero(image);
+    cost.samplesPerRow = settings.samplesPerRow;
+    return cost;
+}
+
+size_t estimateJobMemory(cv::Size imageSize, int channels, const SynthesisSettings& settings, bool bufferedOutput) {
+    size_t pixels = static_cast<size_t>(imageSize.width) * imageSize.height;
+
+    // Decoded image and its split channels, then the gray copy and the rotated gray and alpha planes
+    // with one flip temporary each
+    size_t imageBytes = pixels * channels * 2 + pixels * 5;
+
+    // Image columns become time rows; streamed output only keeps one row of samples
+    size_t outputSamples = bufferedOutput ? static_cast<size_t>(imageSize.width) * settings.samplesPerRow : settings.samplesPerRow;
+    return imageBytes + outputSamples * sizeof(short);
+}
+
+cv::Mat processImage(const std::string& filePath, cv::Mat& alphaChannel, const DecodeOptions& options) {
     std::cout << "Processing image..." << std::endl;
 
-    // Read the image using OpenCV
-    cv::Mat image = cv::imread(filePath, cv::IMREAD_UNCHANGED); // Ensure the alpha channel is preserved
+    // Raw inputs stay mapped while preprocessing reads the pixels in place
+    auto decodeStart = std::chrono::steady_clock::now();
+    bool rgbOrder = false;
+    MappedFile mappedFile;
+    cv::Mat image = decodeInput(filePath, options, mappedFile, rgbOrder);
     if (image.empty()) {
         std::cerr << "Error: Could not open or find the image." << std::endl;
         return cv::Mat();
     }
 
-    // Check if the image has 4 channels (including alpha)
-    if (image.channels() != 4) {
-        std::cerr << "Error: Image does not have 4 channels (including alpha)." << std::endl;
+    // With --verbose, report decode throughput so the backends can be compared
+    if (options.verbose) {
+        std::string decoderName = "OpenCV";
+        if (isRawImage(filePath)) {
+            decoderName = "memory map";
+        }
+        else if (options.pngDecoder == PngDecoder::Spng && lowercaseExtension(filePath) == ".png") {
+            decoderName = "spng";
+        }
+
+        double decodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - decodeStart).count();
+        double decodedMegabytes = static_cast<double>(image.total() * image.elemSize()) / (1024.0 * 1024.0);
+        std::cout << "Decoded " << filePath << " with " << decoderName << " in "
+            << std::fixed << std::setprecision(2) << decodeSeconds * 1000.0 << " ms ("
+            << decodedMegabytes / std::max(decodeSeconds, 1e-9) << " MB/s)." << std::endl;
+    }
+
+    cv::Mat rotatedImage = preprocessFrame(image, alphaChannel, rgbOrder);
+    if (rotatedImage.empty()) {
         return cv::Mat();
     }
 
-    // Separate the alpha channel
-    std::vector<cv::Mat> channels(4);
-    cv::split(image, channels);
-    alphaChannel = channels[3];
+    std::cout << "Image processed successfully." << std::endl;
+
+    return rotatedImage;
+}
+
+cv::Mat decodeInput(const std::string& filePath, const DecodeOptions& options, MappedFile& mappedFile, bool& rgbOrder) {
+    if (isRawImage(filePath)) {
+        cv::Mat image = mapRawImage(filePath, options.rawSize, mappedFile, rgbOrder);
+        return resizeToOscillators(image, options.targetOscillators);
+    }
+    return decodeImage(filePath, options, rgbOrder);
+}
+
+cv::Mat decodeImage(const std::string& filePath, const DecodeOptions& options, bool& rgbOrder) {
+    std::string extension = lowercaseExtension(filePath);
+
+    // JPEGs have no alpha, so decode straight to grayscale unless the color is wanted, which skips
+    // the color conversion and two thirds of the pixel buffer. There is no reduced decode: the
+    // decoder's DCT-domain scaling shrinks the width too, and the width is the time axis. With
+    // --oscillators the image is still decoded at full size and then resized, so the option cuts
+    // synthesis work but adds to decode time and peak memory rather than saving any
+    if (extension == ".jpg" || extension == ".jpeg") {
+        // Orientation is ignored as in the unchanged decode of the other formats
+        int flags = options.keepColor ? cv::IMREAD_COLOR : cv::IMREAD_GRAYSCALE;
+        cv::Mat image = cv::imread(filePath, flags | cv::IMREAD_IGNORE_ORIENTATION);
+        if (image.empty()) {
+            return cv::Mat();
+        }
+
+        return resizeToOscillators(image, options.targetOscillators);
+    }
+
+    cv::Mat image;
+    if (options.pngDecoder == PngDecoder::Spng && extension == ".png") {
+        image = decodePngWithSpng(filePath);
+        rgbOrder = true;
+    }
+    else {
+        // Read the image using OpenCV
+        image = cv::imread(filePath, cv::IMREAD_UNCHANGED); // Ensure the alpha channel is preserved
+    }
 
-    if (alphaChannel.empty()) {
-        std::cerr << "Error: Alpha channel is empty." << std::endl;
+    if (image.empty()) {
         return cv::Mat();
     }
 
-    // Process the image converting it to grayscale
-    cv::Mat grayImage;
-    cv::cvtColor(image, grayImage, cv::COLOR_BGR2GRAY);
+    return resizeToOscillators(image, options.targetOscillators);
+}
 
-    if (grayImage.empty()) {
-        std::cerr << "Error: Grayscale image is empty." << std::endl;
+cv::Mat decodePngWithSpng(const std::string& filePath) {
+#if SOUNDCANVAS_HAS_SPNG
+    std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+    if (!file) {
         return cv::Mat();
     }
 
-    // Rotate the image and alpha channel 90 degrees counterclockwise
-    cv::Mat rotatedImage, rotatedAlpha;
-    cv::rotate(grayImage, rotatedImage, cv::ROTATE_90_COUNTERCLOCKWISE);
-    cv::rotate(alphaChannel, rotatedAlpha, cv::ROTATE_90_COUNTERCLOCKWISE);
+    std::vector<char> encoded(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    if (!file.read(encoded.data(), static_cast<std::streamsize>(encoded.size()))) {
+        return cv::Mat();
+    }
+
+    spng_ctx* context = spng_ctx_new(0);
+    if (!context) {
+        return cv::Mat();
+    }
+
+    cv::Mat image;
+    spng_ihdr ihdr;
+    spng_set_png_buffer(context, encoded.data(), encoded.size());
+
+    int format = 0;
+    int type = 0;
+    int flags = 0;
+    if (spng_get_ihdr(context, &ihdr) == 0 && chooseSpngFormat(context, format, type, flags)) {
+        size_t decodedSize = 0;
+        if (spng_decoded_image_size(context, format, &decodedSize) == 0) {
+            image.create(static_cast<int>(ihdr.height), static_cast<int>(ihdr.width), type);
+            if (spng_decode_image(context, image.data, decodedSize, format, flags) != 0) {
+                image.release();
+            }
+        }
+    }
+
+    spng_ctx_free(context);
+    return image;
+#else
+    (void)filePath;
+    return cv::Mat();
+#endif
+}
+
+bool chooseSpngFormat(spng_ctx* context, int& format, int& type, int& flags) {
+#if SOUNDCANVAS_HAS_SPNG
+    spng_ihdr ihdr;
+    if (spng_get_ihdr(context, &ihdr) != 0) {
+        return false;
+    }
+
+    // Grayscale sources decode straight to gray, everything else to RGB. Alpha is only added when
+    // the image has some, so opaque PNGs reach synthesis without a constant 255 alpha plane
+    spng_trns trns;
+    bool hasAlpha = ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE_ALPHA || ihdr.color_type == SPNG_COLOR_TYPE_TRUECOLOR_ALPHA
+        || spng_get_trns(context, &trns) == 0;
+    bool isGray = (ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE || ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE_ALPHA) && ihdr.bit_depth <= 8;
+
+    if (isGray) {
+        format = hasAlpha ? SPNG_FMT_GA8 : SPNG_FMT_G8;
+        type = hasAlpha ? CV_8UC2 : CV_8UC1;
+    }
+    else {
+        format = hasAlpha ? SPNG_FMT_RGBA8 : SPNG_FMT_RGB8;
+        type = hasAlpha ? CV_8UC4 : CV_8UC3;
+    }
+    flags = hasAlpha ? SPNG_DECODE_TRNS : 0;
+    return true;
+#else
+    (void)context;
+    (void)format;
+    (void)type;
+    (void)flags;
+    return false;
+#endif
+}
+
+bool readImageSize(const std::string& filePath, cv::Size& size) {
+    std::ifstream file(filePath, std::ios::binary);
+    unsigned char header[24];
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header))) {
+        return false;
+    }
+
+    // PNG keeps the dimensions in the IHDR chunk right after the signature
+    if (header[0] == 0x89 && header[1] == 'P' && header[2] == 'N' && header[3] == 'G') {
+        size.width = (header[16] << 24) | (header[17] << 16) | (header[18] << 8) | header[19];
+        size.height = (header[20] << 24) | (header[21] << 16) | (header[22] << 8) | header[23];
+        return size.width > 0 && size.height > 0;
+    }
+
+    if (header[0] != 0xFF || header[1] != 0xD8) {
+        return false;
+    }
+
+    // JPEG keeps them in the first start-of-frame segment
+    file.seekg(2);
+    unsigned char marker[4];
+    while (file.read(reinterpret_cast<char*>(marker), 2)) {
+        if (marker[0] != 0xFF) {
+            return false;
+        }
+        if (marker[1] == 0xFF) {
+            file.seekg(-1, std::ios::cur); // Fill byte
+            continue;
+        }
+        if (marker[1] == 0x01 || (marker[1] >= 0xD0 && marker[1] <= 0xD8)) {
+            continue; // Standalone markers have no length
+        }
+        if (!file.read(reinterpret_cast<char*>(marker + 2), 2)) {
+            return false;
+        }
+
+        int length = (marker[2] << 8) | marker[3];
+        bool isStartOfFrame = marker[1] >= 0xC0 && marker[1] <= 0xCF && marker[1] != 0xC4 && marker[1] != 0xC8 && marker[1] != 0xCC;
+
+        if (isStartOfFrame) {
+            unsigned char frame[5];
+            if (!file.read(reinterpret_cast<char*>(frame), sizeof(frame))) {
+                return false;
+            }
+            size.height = (frame[1] << 8) | frame[2];
+            size.width = (frame[3] << 8) | frame[4];
+            return size.width > 0 && size.height > 0;
+        }
+
+        file.seekg(length - 2, std::ios::cur);
+    }
+
+    return false;
+}
+
+cv::Mat resizeToOscillators(const cv::Mat& image, int targetOscillators) {
+    if (targetOscillators <= 0 || image.rows <= targetOscillators) {
+        return image;
+    }
+
+    // Image rows become oscillators and columns set the duration, so only the height is reduced.
+    // This runs after a full-size decode for every format; it saves synthesis time, not decoding
+    cv::Mat resized;
+    cv::resize(image, resized, cv::Size(image.cols, targetOscillators), 0, 0, cv::INTER_AREA);
+    return resized;
+}
+
+bool isRawImage(const std::string& filePath) {
+    std::string extension = lowercaseExtension(filePath);
+    return extension == ".pam" || extension == ".pgm" || extension == ".rgba" || extension == ".ga";
+}
+
+cv::Mat mapRawImage(const std::string& filePath, cv::Size rawSize, MappedFile& mappedFile, bool& rgbOrder) {
+    if (!mapFile(mappedFile, filePath)) {
+        return cv::Mat();
+    }
+
+    std::string extension = lowercaseExtension(filePath);
+    const unsigned char* data = mappedFile.data;
+    size_t size = mappedFile.size;
+    size_t offset = 0;
+    int width = rawSize.width;
+    int height = rawSize.height;
+    int depth = extension == ".ga" ? 2 : 4;
+    int maxValue = 255;
+
+    // Reads the next whitespace separated header token, skipping # comments
+    auto nextToken = [&]() {
+        std::string token;
+        while (offset < size) {
+            if (data[offset] == '#') {
+                while (offset < size && data[offset] != '\n') {
+                    ++offset;
+                }
+            }
+            else if (std::isspace(data[offset])) {
+                if (!token.empty()) {
+                    break;
+                }
+                ++offset;
+            }
+            else {
+                token += static_cast<char>(data[offset++]);
+            }
+        }
+        return token;
+    };
+
+    if (extension == ".pgm") {
+        if (nextToken() != "P5") {
+            std::cerr << "Error: " << filePath << " is not a binary PGM file." << std::endl;
+            return cv::Mat();
+        }
+        width = std::atoi(nextToken().c_str());
+        height = std::atoi(nextToken().c_str());
+        maxValue = std::atoi(nextToken().c_str());
+        depth = 1;
+        ++offset; // Single whitespace byte before the pixel data
+    }
+    else if (extension == ".pam") {
+        if (nextToken() != "P7") {
+            std::cerr << "Error: " << filePath << " is not a PAM file." << std::endl;
+            return cv::Mat();
+        }
+        for (std::string token = nextToken(); !token.empty() && token != "ENDHDR"; token = nextToken()) {
+            if (token == "WIDTH") {
+                width = std::atoi(nextToken().c_str());
+            }
+            else if (token == "HEIGHT") {
+                height = std::atoi(nextToken().c_str());
+            }
+            else if (token == "DEPTH") {
+                depth = std::atoi(nextToken().c_str());
+            }
+            else if (token == "MAXVAL") {
+                maxValue = std::atoi(nextToken().c_str());
+            }
+            else if (token == "TUPLTYPE") {
+                nextToken();
+            }
+        }
+        ++offset; // Newline after ENDHDR
+    }
+
+    if (width <= 0 || height <= 0) {
+        std::cerr << "Error: Raw image dimensions are unknown, pass them with --size WxH." << std::endl;
+        return cv::Mat();
+    }
+    if (depth < 1 || depth > 4 || maxValue != 255) {
+        std::cerr << "Error: Only 8-bit raw images with 1 to 4 channels are supported." << std::endl;
+        return cv::Mat();
+    }
+
+    size_t pixelBytes = static_cast<size_t>(width) * height * depth;
+    if (offset > size || size - offset < pixelBytes) {
+        std::cerr << "Error: " << filePath << " is smaller than its dimensions require." << std::endl;
+        return cv::Mat();
+    }
+
+    // Wrap the mapped pixels without copying; raw color layouts are RGB(A)
+    rgbOrder = true;
+    return cv::Mat(height, width, CV_8UC(depth), const_cast<unsigned char*>(data + offset));
+}
+
+bool mapFile(MappedFile& mappedFile, const std::string& filePath) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    CloseHandle(file);
+
+    if (!mapping) {
+        return false;
+    }
+
+    // The view keeps the mapping alive on its own
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+
+    if (!view) {
+        return false;
+    }
+
+    mappedFile.data = static_cast<const unsigned char*>(view);
+    mappedFile.size = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+#else
+    int descriptor = open(filePath.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        return false;
+    }
+
+    struct stat fileStatus;
+    void* view = MAP_FAILED;
+    if (fstat(descriptor, &fileStatus) == 0 && fileStatus.st_size > 0) {
+        view = mmap(nullptr, static_cast<size_t>(fileStatus.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+    }
+    close(descriptor);
+
+    if (view == MAP_FAILED) {
+        return false;
+    }
+
+    madvise(view, static_cast<size_t>(fileStatus.st_size), MADV_SEQUENTIAL);
+    mappedFile.data = static_cast<const unsigned char*>(view);
+    mappedFile.size = static_cast<size_t>(fileStatus.st_size);
+    return true;
+#endif
+}
+
+void unmapFile(MappedFile& mappedFile) {
+    if (!mappedFile.data) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(mappedFile.data);
+#else
+    munmap(const_cast<unsigned char*>(mappedFile.data), mappedFile.size);
+#endif
+
+    mappedFile.data = nullptr;
+    mappedFile.size = 0;
+}
+
+MappedFile::~MappedFile() {
+    unmapFile(*this);
+}
+
+std::string lowercaseExtension(const std::string& filePath) {
+    std::string extension = std::filesystem::path(filePath).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension;
+}
 
-    // Flip the image and alpha channel vertically and horizontally to correct the mirroring effect
-    cv::flip(rotatedImage, rotatedImage, 0);
-    cv::flip(rotatedImage, rotatedImage, 1);
-    cv::flip(rotatedAlpha, rotatedAlpha, 0);
-    cv::flip(rotatedAlpha, rotatedAlpha, 1);
+cv::Mat preprocessFrame(const cv::Mat& image, cv::Mat& alphaChannel, bool rgbOrder) {
+    cv::Mat grayImage = splitGrayAlpha(image, alphaChannel, rgbOrder);
+    if (grayImage.empty()) {
+        return cv::Mat();
+    }
 
-    if (rotatedImage.empty() || rotatedAlpha.empty()) {
+    // Opaque images have no alpha plane to turn
+    cv::Mat rotatedImage = orientPlane(grayImage);
+    cv::Mat rotatedAlpha = alphaChannel.empty() ? cv::Mat() : orientPlane(alphaChannel);
+
+    if (rotatedImage.empty() || (rotatedAlpha.empty() && !alphaChannel.empty())) {
         std::cerr << "Error: Rotated image or alpha channel is empty." << std::endl;
         return cv::Mat();
     }
@@ -95,93 +837,615 @@ cv::Mat processImage(const std::string& filePath, cv::Mat& alphaChannel) {
     // Update the alpha channel with the processed version
     alphaChannel = rotatedAlpha;
 
-    std::cout << "Image processed successfully." << std::endl;
-
     return rotatedImage;
 }
 
-void generateWavFile(const std::string& outputFilePath, const cv::Mat& image, const cv::Mat& alphaChannel) {
-    std::cout << "Generating WAV file..." << std::endl;
+cv::Mat splitGrayAlpha(const cv::Mat& image, cv::Mat& alphaChannel, bool rgbOrder) {
+    cv::Mat grayImage;
 
-    if (image.empty() || alphaChannel.empty()) {
-        std::cerr << "Error: No image data to convert to WAV." << std::endl;
-        return;
+    if (image.channels() == 2) {
+        // Gray+alpha needs no color conversion, only the split
+        std::vector<cv::Mat> channels(2);
+        cv::split(image, channels);
+        grayImage = channels[0];
+        alphaChannel = channels[1];
     }
+    else if (image.channels() == 4) {
+        // Separate the alpha channel
+        std::vector<cv::Mat> channels(4);
+        cv::split(image, channels);
+        alphaChannel = channels[3];
 
-    // Ensure the alpha channel has the same dimensions as the image
-    if (image.size() != alphaChannel.size()) {
-        std::cerr << "Error: Image and alpha channel dimensions do not match." << std::endl;
-        return;
+        if (alphaChannel.empty()) {
+            std::cerr << "Error: Alpha channel is empty." << std::endl;
+            return cv::Mat();
+        }
+
+        // Process the image converting it to grayscale
+        cv::cvtColor(image, grayImage, rgbOrder ? cv::COLOR_RGBA2GRAY : cv::COLOR_BGR2GRAY);
+    }
+    else if (image.channels() == 1 || image.channels() == 3) {
+        // Formats without alpha such as JPEG are fully opaque, which synthesis takes from an empty
+        // alpha plane rather than one filled with 255
+        if (image.channels() == 1) {
+            grayImage = image;
+        }
+        else {
+            cv::cvtColor(image, grayImage, rgbOrder ? cv::COLOR_RGB2GRAY : cv::COLOR_BGR2GRAY);
+        }
+        alphaChannel.release();
+    }
+    else {
+        std::cerr << "Error: Image does not have 1 to 4 channels." << std::endl;
+        return cv::Mat();
     }
 
-    // Define WAV file parameters
-    SF_INFO sfInfo;
-    sfInfo.channels = 1;
-    sfInfo.samplerate = 44100;
-    sfInfo.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+    if (grayImage.empty()) {
+        std::cerr << "Error: Grayscale image is empty." << std::endl;
+    }
+    return grayImage;
+}
 
-    // Open the WAV file for writing
-    SNDFILE* outFile = sf_open(outputFilePath.c_str(), SFM_WRITE, &sfInfo);
-    if (!outFile) {
-        std::cerr << "Error: Could not open output WAV file." << std::endl;
-        return;
+cv::Mat orientPlane(const cv::Mat& plane) {
+    // Rotate the plane 90 degrees counterclockwise
+    cv::Mat rotatedPlane;
+    cv::rotate(plane, rotatedPlane, cv::ROTATE_90_COUNTERCLOCKWISE);
+
+    // Flip the plane vertically and horizontally to correct the mirroring effect
+    cv::flip(rotatedPlane, rotatedPlane, 0);
+    cv::flip(rotatedPlane, rotatedPlane, 1);
+    return rotatedPlane;
+}
+
+bool isStillImage(const std::string& filePath) {
+    std::string extension = lowercaseExtension(filePath);
+
+    const std::vector<std::string> imageExtensions = { ".png", ".jpg", ".jpeg", ".webp", ".tif", ".tiff" };
+    return isRawImage(filePath) || std::find(imageExtensions.begin(), imageExtensions.end(), extension) != imageExtensions.end();
+}
+
+bool isFrameStream(const std::string& filePath) {
+    // Numbered image sequences are given as a printf-style pattern
+    if (filePath.find('%') != std::string::npos) {
+        return true;
     }
 
-    // Convert image data to audio data
-    std::vector<short> audioData;
-    int sampleRate = sfInfo.samplerate;
-    int samplesPerRow = sampleRate / 10; // Reduce the number of samples per row to shorten the duration
+    std::string extension = lowercaseExtension(filePath);
 
-    double minFrequency = 200.0; // in Hz
-    double maxFrequency = 8000.0; // in Hz
-    double frequencyRange = maxFrequency - minFrequency;
+    const std::vector<std::string> streamExtensions = { ".gif", ".apng", ".mp4", ".m4v", ".mov", ".avi", ".mkv", ".webm" };
+    if (std::find(streamExtensions.begin(), streamExtensions.end(), extension) != streamExtensions.end()) {
+        return true;
+    }
 
-    for (int row = 0; row < image.rows; ++row) {
-        for (int i = 0; i < samplesPerRow; ++i) {
-            double t = static_cast<double>(i + row * samplesPerRow) / sampleRate;
-            double sampleValue = 0.0;
+    return extension == ".png" && isAnimatedPng(filePath);
+}
 
-            for (int col = 0; col < image.cols; ++col) {
-                double frequency = minFrequency + (frequencyRange * col / (image.cols - 1)); // Map column to frequency
-                double intensity = static_cast<double>(image.at<uchar>(row, col)) / 255.0; // Grayscale intensity
-                double alpha = static_cast<double>(alphaChannel.at<uchar>(row, col)) / 255.0; // Alpha channel
+bool isAnimatedPng(const std::string& filePath) {
+    std::ifstream file(filePath, std::ios::binary);
+    unsigned char signature[8];
+    if (!file.read(reinterpret_cast<char*>(signature), sizeof(signature))) {
+        return false;
+    }
 
-                double amplitude = alpha < 0.1 ? 0.1 : alpha;
-                sampleValue += intensity * amplitude * sin(2.0 * CV_PI * frequency * t);
-            }
+    // An APNG announces its animation control chunk before the first image data chunk
+    unsigned char header[8];
+    while (file.read(reinterpret_cast<char*>(header), sizeof(header))) {
+        unsigned long length = (static_cast<unsigned long>(header[0]) << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+        std::string type(reinterpret_cast<char*>(header + 4), 4);
+
+        if (type == "acTL") {
+            return true;
+        }
+        if (type == "IDAT" || type == "IEND") {
+            return false;
+        }
 
-            sampleValue = std::clamp(sampleValue, -1.0, 1.0);
-            audioData.push_back(static_cast<short>(sampleValue * 32767));
+        file.seekg(static_cast<std::streamoff>(length) + 4, std::ios::cur); // Skip chunk data and CRC
+    }
+
+    return false;
+}
+
+bool openFrameReader(FrameReader& reader, const std::string& inputPath) {
+    if (inputPath.find('%') == std::string::npos) {
+        // Videos, GIFs and APNGs are decoded through the video backend
+        if (!reader.capture.open(inputPath)) {
+            std::cerr << "Error: Could not open " << inputPath << " as an animation or video." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Numbered sequences are read frame by frame so the alpha channel is preserved; start at 0 or 1
+    reader.sequencePattern = inputPath;
+    for (int firstIndex = 0; firstIndex <= 1; ++firstIndex) {
+        char fileName[4096];
+        std::snprintf(fileName, sizeof(fileName), inputPath.c_str(), firstIndex);
+        if (std::filesystem::exists(fileName)) {
+            reader.sequenceIndex = firstIndex;
+            return true;
         }
+    }
+
+    std::cerr << "Error: No frames found matching " << inputPath << "." << std::endl;
+    return false;
+}
+
+bool readNextFrame(FrameReader& reader, cv::Mat& frame) {
+    if (!reader.sequencePattern.empty()) {
+        char fileName[4096];
+        std::snprintf(fileName, sizeof(fileName), reader.sequencePattern.c_str(), reader.sequenceIndex++);
+        if (!std::filesystem::exists(fileName)) {
+            return false;
+        }
+
+        frame = cv::imread(fileName, cv::IMREAD_UNCHANGED);
+        return !frame.empty();
+    }
+
+    // Video frames carry no alpha; preprocessing takes them as they are and treats them as opaque
+    return reader.capture.read(frame) && !frame.empty();
+}
+
+bool generateWavFile(const std::string& outputFilePath, const cv::Mat& image, const cv::Mat& alphaChannel, bool showProgress, bool resume) {
+    if (showProgress) {
+        std::cout << "Generating WAV file..." << std::endl;
+    }
+
+    if (image.empty()) {
+        std::cerr << "Error: No image data to convert to WAV." << std::endl;
+        return false;
+    }
+
+    // Ensure the alpha channel, when there is one, has the same dimensions as the image
+    if (!alphaChannel.empty() && image.size() != alphaChannel.size()) {
+        std::cerr << "Error: Image and alpha channel dimensions do not match." << std::endl;
+        return false;
+    }
+
+    SynthesisSettings settings;
+    std::string checkpointPath = outputFilePath + ".checkpoint";
+
+    RenderCheckpoint checkpoint;
+    checkpoint.rows = image.rows;
+    checkpoint.cols = image.cols;
+    checkpoint.sampleRate = settings.sampleRate;
+    checkpoint.samplesPerRow = settings.samplesPerRow;
+    checkpoint.minFrequency = settings.minFrequency;
+    checkpoint.maxFrequency = settings.maxFrequency;
+    bool planesHashed = false; // Hashing takes a pass over the image, so it waits until a checkpoint needs it
+
+    // Open the WAV file for writing, or continue the one an interrupted run left behind
+    WavStream stream;
+    int firstRow = 0;
+    RenderCheckpoint saved;
+
+    if (resume && readCheckpoint(checkpointPath, saved)) {
+        checkpoint.planesHash = hashImagePlanes(image, alphaChannel);
+        planesHashed = true;
+
+        bool sameRender = saved.rows == checkpoint.rows && saved.cols == checkpoint.cols && saved.planesHash == checkpoint.planesHash
+            && saved.sampleRate == checkpoint.sampleRate && saved.samplesPerRow == checkpoint.samplesPerRow
+            && saved.minFrequency == checkpoint.minFrequency && saved.maxFrequency == checkpoint.maxFrequency
+            && saved.nextRow > 0 && saved.nextRow <= image.rows;
+
+        if (sameRender && resumeWavStream(stream, outputFilePath, settings, saved)) {
+            firstRow = saved.nextRow;
+            std::cout << "Resuming at row " << firstRow << " of " << image.rows << "." << std::endl;
+        }
+        else {
+            std::cout << "Checkpoint does not match this render, starting from the beginning." << std::endl;
+        }
+    }
+
+    if (!stream.file) {
+        if (!openWavStream(stream, outputFilePath, settings)) {
+            return false;
+        }
+
+        // The WAV was just truncated, so an older checkpoint no longer describes it; left in place,
+        // an interrupted fresh render could later be resumed against it
+        std::error_code staleError;
+        std::filesystem::remove(checkpointPath, staleError);
+    }
+
+    // Convert image data to audio data one row at a time
+    std::vector<short> rowSamples(settings.samplesPerRow);
+    ScratchArena scratch;
+
+    const std::chrono::seconds checkpointInterval(10);
+    auto renderStart = std::chrono::steady_clock::now();
+    auto lastCheckpoint = renderStart;
+    double checkpointSeconds = 0.0;
+    int checkpointCount = 0;
+
+    for (int row = firstRow; row < image.rows; ++row) {
+        scratch.reset();
+        synthesizeRow(image.ptr<uchar>(row), alphaRowOf(alphaChannel, row), image.cols,
+            static_cast<long long>(row) * settings.samplesPerRow, settings, rowSamples.data(), &scratch);
+        writeWavStream(stream, rowSamples.data(), rowSamples.size());
 
         // Output progress every 10 rows
-        if (row % 10 == 0) {
+        if (showProgress && row % 10 == 0) {
             double progress = (static_cast<double>(row) / image.rows) * 100.0;
             std::cout << "Progress: " << std::fixed << std::setprecision(2) << progress << "%" << std::endl;
         }
+
+        // Samples depend only on their absolute position, so rendering from nextRow on after a restart
+        // gives the same output as never stopping; the WAV is flushed first so a checkpoint never
+        // points past what is on disk
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastCheckpoint >= checkpointInterval && row + 1 < image.rows) {
+            if (!planesHashed) {
+                checkpoint.planesHash = hashImagePlanes(image, alphaChannel);
+                planesHashed = true;
+            }
+
+            checkpoint.nextRow = row + 1;
+            checkpoint.framesWritten = stream.framesWritten;
+            checkpoint.audibleFrames = stream.audibleFrames;
+            syncWavStream(stream);
+            if (writeCheckpoint(checkpointPath, checkpoint)) {
+                checkpointCount++;
+            }
+
+            lastCheckpoint = std::chrono::steady_clock::now();
+            checkpointSeconds += std::chrono::duration<double>(lastCheckpoint - now).count();
+        }
     }
 
-    const short silenceThreshold = 500;
+    // Close the WAV file
+    closeWavStream(stream);
+
+    std::error_code removeError;
+    std::filesystem::remove(checkpointPath, removeError);
 
-    // Identify the start and end of the non-silent parts
-    size_t start = 0;
-    while (start < audioData.size() && std::abs(audioData[start]) < silenceThreshold) {
-        ++start;
+    if (showProgress && checkpointCount > 0) {
+        double renderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+        std::cout << "Checkpoints: " << checkpointCount << " written in " << std::fixed << std::setprecision(2)
+            << checkpointSeconds * 1000.0 << " ms (" << checkpointSeconds / std::max(renderSeconds, 1e-9) * 100.0
+            << "% of render time)." << std::endl;
     }
 
-    size_t end = audioData.size();
-    while (end > start && std::abs(audioData[end - 1]) < silenceThreshold) {
-        --end;
+    if (showProgress) {
+        std::cout << "WAV file generated successfully." << std::endl;
     }
+    return true;
+}
+
+bool generateWavFromFrames(const std::string& outputFilePath, const std::string& inputPath, const DecodeOptions& options) {
+    std::cout << "Generating WAV file from frames..." << std::endl;
 
-    // Trim the audio data to include only the non-silent parts
-    std::vector<short> trimmedAudioData(audioData.begin() + start, audioData.begin() + end);
+    FrameReader reader;
+    if (!openFrameReader(reader, inputPath)) {
+        return false;
+    }
 
-    // Write trimmed audio data to the WAV file
-    sf_write_short(outFile, trimmedAudioData.data(), trimmedAudioData.size());
+    SynthesisSettings settings;
 
-    // Close the WAV file
-    sf_close(outFile);
+    WavStream stream;
+    if (!openWavStream(stream, outputFilePath, settings)) {
+        return false;
+    }
+
+    // Preprocessed frames handed from the decoder thread to the synthesizer
+    struct PreparedFrame {
+        cv::Mat image;
+        cv::Mat alpha;
+    };
+
+    // Keep only a few frames in flight so memory stays bounded regardless of stream length
+    const size_t maxQueuedFrames = 3;
+    std::deque<PreparedFrame> queue;
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    bool decodingDone = false;
+    bool decodingFailed = false;
+
+    // Decode and preprocess later frames while earlier ones are being synthesized
+    std::thread decoder([&]() {
+        cv::Mat frame;
+        while (readNextFrame(reader, frame)) {
+            PreparedFrame prepared;
+            prepared.image = preprocessFrame(resizeToOscillators(frame, options.targetOscillators), prepared.alpha);
+            if (prepared.image.empty()) {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                decodingFailed = true;
+                break;
+            }
+
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueChanged.wait(lock, [&]() { return queue.size() < maxQueuedFrames; });
+            queue.push_back(std::move(prepared));
+            queueChanged.notify_all();
+        }
+
+        std::lock_guard<std::mutex> lock(queueMutex);
+        decodingDone = true;
+        queueChanged.notify_all();
+    });
+
+    std::vector<short> rowSamples(settings.samplesPerRow);
+    ScratchArena scratch;
+    long long nextSample = 0;
+    int frameCount = 0;
+
+    while (true) {
+        PreparedFrame prepared;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueChanged.wait(lock, [&]() { return !queue.empty() || decodingDone; });
+            if (queue.empty()) {
+                break;
+            }
+            prepared = std::move(queue.front());
+            queue.pop_front();
+            queueChanged.notify_all();
+        }
+
+        // Frames follow each other on the timeline, so each one continues at the running sample position
+        for (int row = 0; row < prepared.image.rows; ++row) {
+            scratch.reset();
+            synthesizeRow(prepared.image.ptr<uchar>(row), alphaRowOf(prepared.alpha, row), prepared.image.cols,
+                nextSample, settings, rowSamples.data(), &scratch);
+            writeWavStream(stream, rowSamples.data(), rowSamples.size());
+            nextSample += settings.samplesPerRow;
+        }
+
+        std::cout << "Progress: frame " << ++frameCount << std::endl;
+    }
+
+    decoder.join();
+    closeWavStream(stream);
+
+    if (decodingFailed) {
+        std::cerr << "Error: Frame " << frameCount + 1 << " could not be processed." << std::endl;
+        return false;
+    }
+    if (frameCount == 0) {
+        std::cerr << "Error: No frames could be decoded." << std::endl;
+        return false;
+    }
 
     std::cout << "WAV file generated successfully." << std::endl;
+    return true;
+}
+
+void synthesizeRow(const uchar* intensityRow, const uchar* alphaRow, int cols, long long firstSample, const SynthesisSettings& settings, short* output,
+    std::pmr::memory_resource* scratch) {
+    // Gather frequency and amplitude of the audible columns once per row instead of once per sample;
+    // callers rendering many rows pass an arena so these tables do not hit the heap every row
+    std::pmr::vector<double> frequencies(scratch);
+    std::pmr::vector<double> amplitudes(scratch);
+    gatherOscillators(intensityRow, alphaRow, cols, settings, frequencies, amplitudes);
+
+    synthesizeOscillators(frequencies.data(), amplitudes.data(), frequencies.size(), firstSample, settings, output);
+}
+
+void gatherOscillators(const uchar* intensityRow, const uchar* alphaRow, int cols, const SynthesisSettings& settings,
+    std::pmr::vector<double>& frequencies, std::pmr::vector<double>& amplitudes) {
+    frequencies.reserve(frequencies.size() + cols);
+    amplitudes.reserve(amplitudes.size() + cols);
+
+    // Opaque rows skip the alpha read and floor altogether
+    if (!alphaRow) {
+        for (int col = 0; col < cols; ++col) {
+            if (intensityRow[col] != 0) {
+                frequencies.push_back(columnFrequency(col, cols, settings));
+                amplitudes.push_back(opaqueAmplitude(intensityRow[col]));
+            }
+        }
+        return;
+    }
+
+    for (int col = 0; col < cols; ++col) {
+        if (intensityRow[col] == 0) {
+            continue; // Black pixels contribute nothing
+        }
+
+        frequencies.push_back(columnFrequency(col, cols, settings));
+        amplitudes.push_back(pixelAmplitude(intensityRow[col], alphaRow[col]));
+    }
+}
+
+double columnFrequency(int col, int cols, const SynthesisSettings& settings) {
+    // Map column to frequency
+    double frequencyRange = settings.maxFrequency - settings.minFrequency;
+    return cols > 1 ? settings.minFrequency + (frequencyRange * col / (cols - 1)) : settings.minFrequency;
+}
+
+double pixelAmplitude(uchar intensityValue, uchar alphaValue) {
+    double intensity = static_cast<double>(intensityValue) / 255.0; // Grayscale intensity
+    double alpha = static_cast<double>(alphaValue) / 255.0; // Alpha channel
+
+    double amplitude = alpha < 0.1 ? 0.1 : alpha;
+    return intensity * amplitude;
+}
+
+double opaqueAmplitude(uchar intensityValue) {
+    // Same value pixelAmplitude gives at full alpha
+    return static_cast<double>(intensityValue) / 255.0;
+}
+
+void synthesizeOscillators(const double* frequencies, const double* amplitudes, size_t count, long long firstSample, const SynthesisSettings& settings, short* output) {
+    for (int i = 0; i < settings.samplesPerRow; ++i) {
+        double t = static_cast<double>(firstSample + i) / settings.sampleRate;
+        double sampleValue = 0.0;
+
+        for (size_t k = 0; k < count; ++k) {
+            sampleValue += amplitudes[k] * sin(2.0 * CV_PI * frequencies[k] * t);
+        }
+
+        sampleValue = std::clamp(sampleValue, -1.0, 1.0);
+        output[i] = static_cast<short>(sampleValue * 32767);
+    }
+}
+
+bool writeWavFile(const std::string& outputFilePath, const short* samples, size_t count, const SynthesisSettings& settings) {
+    WavStream stream;
+    if (!openWavStream(stream, outputFilePath, settings)) {
+        return false;
+    }
+
+    writeWavStream(stream, samples, count);
+    closeWavStream(stream);
+    return true;
+}
+
+void renderRows(const cv::Mat& image, const cv::Mat& alphaChannel, int firstRow, int rowCount, const SynthesisSettings& settings, short* output,
+    std::pmr::memory_resource* scratch) {
+    for (int row = firstRow; row < firstRow + rowCount; ++row) {
+        synthesizeRow(image.ptr<uchar>(row), alphaRowOf(alphaChannel, row), image.cols,
+            static_cast<long long>(row) * settings.samplesPerRow, settings, output + static_cast<size_t>(row - firstRow) * settings.samplesPerRow, scratch);
+    }
+}
+
+void findAudibleRange(const short* samples, size_t count, size_t& begin, size_t& end) {
+    begin = 0;
+    while (begin < count && std::abs(samples[begin]) < silenceThreshold) {
+        ++begin;
+    }
+
+    end = count;
+    while (end > begin && std::abs(samples[end - 1]) < silenceThreshold) {
+        --end;
+    }
+}
+
+bool openWavStream(WavStream& stream, const std::string& filePath, const SynthesisSettings& settings) {
+    // Define WAV file parameters
+    SF_INFO sfInfo = {};
+    sfInfo.channels = settings.channels;
+    sfInfo.samplerate = settings.sampleRate;
+    sfInfo.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+
+    stream.file = sf_open(filePath.c_str(), SFM_WRITE, &sfInfo);
+    if (!stream.file) {
+        std::cerr << "Error: Could not open output WAV file." << std::endl;
+        return false;
+    }
+
+    stream.channels = settings.channels;
+    stream.framesWritten = 0;
+    stream.audibleFrames = 0;
+    return true;
+}
+
+void writeWavStream(WavStream& stream, const short* samples, size_t count) {
+    // Skip the leading silence until the first audible sample, keeping whole frames of interleaved output
+    size_t channels = static_cast<size_t>(stream.channels);
+    size_t begin = 0;
+    if (stream.framesWritten == 0) {
+        while (begin < count && std::abs(samples[begin]) < silenceThreshold) {
+            ++begin;
+        }
+        begin -= begin % channels;
+    }
+
+    // Remember where the last audible sample lands so the trailing silence can be cut on close
+    for (size_t i = count; i > begin; --i) {
+        if (std::abs(samples[i - 1]) >= silenceThreshold) {
+            stream.audibleFrames = stream.framesWritten + static_cast<sf_count_t>((i - begin + channels - 1) / channels);
+            break;
+        }
+    }
+
+    if (begin < count) {
+        stream.framesWritten += sf_write_short(stream.file, samples + begin, static_cast<sf_count_t>(count - begin)) / stream.channels;
+    }
+}
+
+void closeWavStream(WavStream& stream) {
+    if (!stream.file) {
+        return;
+    }
+
+    // Trim the trailing silence written after the last audible sample
+    if (stream.audibleFrames < stream.framesWritten) {
+        sf_command(stream.file, SFC_FILE_TRUNCATE, &stream.audibleFrames, sizeof(stream.audibleFrames));
+    }
+
+    sf_close(stream.file);
+    stream.file = nullptr;
+}
+
+bool resumeWavStream(WavStream& stream, const std::string& filePath, const SynthesisSettings& settings, const RenderCheckpoint& checkpoint) {
+    SF_INFO sfInfo = {};
+    stream.file = sf_open(filePath.c_str(), SFM_RDWR, &sfInfo);
+    if (!stream.file) {
+        return false;
+    }
+
+    // The header was updated at the checkpoint, so it covers at least the checkpointed frames
+    if (sfInfo.channels != settings.channels || sfInfo.samplerate != settings.sampleRate || sfInfo.frames < checkpoint.framesWritten) {
+        sf_close(stream.file);
+        stream.file = nullptr;
+        return false;
+    }
+
+    // Drop anything written after the checkpoint and continue from there
+    sf_count_t frames = checkpoint.framesWritten;
+    sf_command(stream.file, SFC_FILE_TRUNCATE, &frames, sizeof(frames));
+    sf_seek(stream.file, frames, SF_SEEK_SET);
+
+    stream.channels = settings.channels;
+    stream.framesWritten = checkpoint.framesWritten;
+    stream.audibleFrames = checkpoint.audibleFrames;
+    return true;
+}
+
+void syncWavStream(WavStream& stream) {
+    sf_command(stream.file, SFC_UPDATE_HEADER_NOW, nullptr, 0);
+    sf_write_sync(stream.file);
+}
+
+bool readCheckpoint(const std::string& checkpointPath, RenderCheckpoint& checkpoint) {
+    std::ifstream file(checkpointPath);
+    std::string magic;
+    if (!(file >> magic) || magic != "SoundCanvasCheckpoint1") {
+        return false;
+    }
+
+    return static_cast<bool>(file >> checkpoint.rows >> checkpoint.cols >> checkpoint.planesHash
+        >> checkpoint.sampleRate >> checkpoint.samplesPerRow >> checkpoint.minFrequency >> checkpoint.maxFrequency
+        >> checkpoint.nextRow >> checkpoint.framesWritten >> checkpoint.audibleFrames);
+}
+
+bool writeCheckpoint(const std::string& checkpointPath, const RenderCheckpoint& checkpoint) {
+    // Written beside the old one and renamed over it, so a crash mid-write leaves the previous checkpoint
+    std::string temporaryPath = checkpointPath + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::trunc);
+        file << "SoundCanvasCheckpoint1\n" << checkpoint.rows << ' ' << checkpoint.cols << ' ' << checkpoint.planesHash << '\n'
+            << checkpoint.sampleRate << ' ' << checkpoint.samplesPerRow << ' ' << std::setprecision(17)
+            << checkpoint.minFrequency << ' ' << checkpoint.maxFrequency << '\n'
+            << checkpoint.nextRow << ' ' << checkpoint.framesWritten << ' ' << checkpoint.audibleFrames << '\n';
+        if (!file.flush()) {
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, checkpointPath, error);
+    return !error;
+}
+
+// 64-bit FNV-1a, cheap enough to run over whole files and pixel planes
+uint64_t hashBytes(const unsigned char* data, size_t size, uint64_t hash) {
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t hashImagePlanes(const cv::Mat& image, const cv::Mat& alphaChannel) {
+    uint64_t hash = hashBytes(reinterpret_cast<const unsigned char*>(&image.rows), sizeof(image.rows));
+    hash = hashBytes(reinterpret_cast<const unsigned char*>(&image.cols), sizeof(image.cols), hash);
+    for (int row = 0; row < image.rows; ++row) {
+        hash = hashBytes(image.ptr<uchar>(row), image.cols, hash);
+        if (!alphaChannel.empty()) {
+            hash = hashBytes(alphaChannel.ptr<uchar>(row), alphaChannel.cols, hash);
+        }
+    }
+    return hash;
 }
@@ -0,0 +1,132 @@
+"""NumPy bindings for the SoundCanvas renderer.
+
+The renderer is loaded from the SoundCanvas shared library through its C interface
+(SoundCanvasApi.h). Build the project sources as a shared library, for example
+
+    g++ -std=c++20 -O2 -shared -fPIC *.cpp -o libsoundcanvas.so $(pkg-config --cflags --libs opencv4 sndfile)
+
+and place it next to this file or point SOUNDCANVAS_LIBRARY at it.
+
+Pixels are handed to the renderer without copying and samples are rendered straight into NumPy
+arrays. ctypes releases the GIL for the duration of every call into the library, so conversions
+running in separate Python threads render in parallel.
+"""
+
+import ctypes
+import os
+import sys
+
+import numpy as np
+
+__all__ = ["SAMPLE_RATE", "render", "render_blocks"]
+
+
+def _load_library():
+    path = os.environ.get("SOUNDCANVAS_LIBRARY")
+    if not path:
+        name = {"win32": "SoundCanvas.dll", "darwin": "libsoundcanvas.dylib"}.get(sys.platform, "libsoundcanvas.so")
+        path = os.path.join(os.path.dirname(os.path.abspath(__file__)), name)
+
+    library = ctypes.CDLL(path)
+    library.soundcanvas_prepare.restype = ctypes.c_void_p
+    library.soundcanvas_prepare.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_size_t]
+    library.soundcanvas_release.restype = None
+    library.soundcanvas_release.argtypes = [ctypes.c_void_p]
+    library.soundcanvas_rows.restype = ctypes.c_int
+    library.soundcanvas_rows.argtypes = [ctypes.c_void_p]
+    library.soundcanvas_samples_per_row.restype = ctypes.c_int
+    library.soundcanvas_samples_per_row.argtypes = []
+    library.soundcanvas_sample_rate.restype = ctypes.c_int
+    library.soundcanvas_sample_rate.argtypes = []
+    library.soundcanvas_render_rows.restype = ctypes.c_int
+    library.soundcanvas_render_rows.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_void_p]
+    library.soundcanvas_audible_range.restype = None
+    library.soundcanvas_audible_range.argtypes = [ctypes.c_void_p, ctypes.c_size_t,
+                                                  ctypes.POINTER(ctypes.c_size_t), ctypes.POINTER(ctypes.c_size_t)]
+    return library
+
+
+_library = _load_library()
+_samples_per_row = _library.soundcanvas_samples_per_row()
+
+SAMPLE_RATE = _library.soundcanvas_sample_rate()
+
+
+class _PreparedImage:
+    """Preprocessed planes held by the library, released when the block exits."""
+
+    def __init__(self, pixels):
+        array = np.asarray(pixels)
+        if array.dtype != np.uint8:
+            raise TypeError("pixels must be a uint8 array")
+        if array.ndim == 2:
+            array = array[:, :, np.newaxis]
+        if array.ndim != 3 or not 1 <= array.shape[2] <= 4:
+            raise ValueError("pixels must have shape (height, width) or (height, width, 1 to 4)")
+
+        # Rows may be strided, as in a crop, but the pixels within a row must be packed; anything
+        # else, such as a flipped view, is copied once into a layout the renderer can read. A single
+        # channel has no channel stride to check, and the axis added to a 2-D array has stride 0
+        height, width, channels = array.shape
+        packed_channels = channels == 1 or array.strides[2] == 1
+        if not packed_channels or array.strides[1] != channels or array.strides[0] < width * channels:
+            array = np.ascontiguousarray(array)
+
+        self.handle = _library.soundcanvas_prepare(array.ctypes.data, width, height, channels, array.strides[0])
+        if not self.handle:
+            raise RuntimeError("SoundCanvas could not preprocess the image")
+        self.rows = _library.soundcanvas_rows(self.handle)
+
+    def render_rows(self, first_row, output):
+        row_count = output.size // _samples_per_row
+        if _library.soundcanvas_render_rows(self.handle, first_row, row_count, output.ctypes.data) != 0:
+            raise RuntimeError("SoundCanvas could not render rows %d to %d" % (first_row, first_row + row_count))
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exception):
+        _library.soundcanvas_release(self.handle)
+        self.handle = None
+
+
+def _convert(samples, dtype):
+    if np.dtype(dtype) == np.int16:
+        return samples
+    if np.dtype(dtype) == np.float32:
+        return samples.astype(np.float32) / 32767.0
+    raise TypeError("dtype must be int16 or float32")
+
+
+def render(pixels, dtype=np.int16, trim=True):
+    """Renders an RGBA, RGB, gray+alpha or gray uint8 array to mono audio at SAMPLE_RATE.
+
+    With trim, leading and trailing silence is cut as in the WAV output; the result is then a view
+    into the rendered buffer. float32 output is scaled to [-1, 1] and costs one conversion pass.
+    """
+    with _PreparedImage(pixels) as image:
+        samples = np.empty(image.rows * _samples_per_row, dtype=np.int16)
+        image.render_rows(0, samples)
+
+    if trim:
+        begin = ctypes.c_size_t()
+        end = ctypes.c_size_t()
+        _library.soundcanvas_audible_range(samples.ctypes.data, samples.size, ctypes.byref(begin), ctypes.byref(end))
+        samples = samples[begin.value:end.value]
+    return _convert(samples, dtype)
+
+
+def render_blocks(pixels, rows_per_block=64, dtype=np.int16):
+    """Yields the audio in blocks of rows_per_block rows as they are rendered, without trimming.
+
+    Blocks follow each other on the timeline, so concatenating them gives the untrimmed render.
+    """
+    if rows_per_block < 1:
+        raise ValueError("rows_per_block must be at least 1")
+
+    with _PreparedImage(pixels) as image:
+        for first_row in range(0, image.rows, rows_per_block):
+            row_count = min(rows_per_block, image.rows - first_row)
+            block = np.empty(row_count * _samples_per_row, dtype=np.int16)
+            image.render_rows(first_row, block)
+            yield _convert(block, dtype)
@@ -0,0 +1,217 @@
+#include "SoundCanvas.h"
+#include "Limiter.h"
+
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <cmath>
+#include <string>
+#include <vector>
+
+// Checks for the parts of the renderer whose output has to stay exact: the limiter's lookahead, the
+// checkpoint file a resumed render trusts, and the out-of-core transpose. Returns nonzero on failure
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& message) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << std::endl;
+        failures++;
+    }
+}
+
+std::string temporaryPath(const std::string& name) {
+    return (std::filesystem::temp_directory_path() / ("soundcanvas-test-" + name)).string();
+}
+
+// Runs every sample through the limiter and then its delay in silence, so output i is input i
+std::vector<double> runLimiter(LookaheadLimiter& limiter, const std::vector<double>& input, int& filling) {
+    std::vector<double> output;
+    filling = 0;
+    double sample = 0.0;
+    for (double value : input) {
+        if (limiter.process(value, sample)) {
+            output.push_back(sample);
+        }
+        else {
+            filling++;
+        }
+    }
+    for (int i = 0; i < limiter.delay(); ++i) {
+        if (limiter.process(0.0, sample)) {
+            output.push_back(sample);
+        }
+    }
+    return output;
+}
+
+void testLimiterLookahead() {
+    const int lookahead = 32;
+    const double ceiling = 0.98;
+
+    // Under the ceiling the limiter is a pure delay of lookahead - 1 samples
+    std::vector<double> quietInput(200);
+    for (size_t i = 0; i < quietInput.size(); ++i) {
+        quietInput[i] = 0.5 * std::sin(0.1 * static_cast<double>(i));
+    }
+    LookaheadLimiter quiet(lookahead, ceiling);
+    int filling = 0;
+    std::vector<double> quietOutput = runLimiter(quiet, quietInput, filling);
+
+    check(filling == lookahead - 1 && quiet.delay() == lookahead - 1, "limiter output trails input by lookahead - 1 samples");
+    check(quietOutput.size() == quietInput.size(), "limiter delay brings out every input sample");
+    bool unchanged = quietOutput.size() == quietInput.size();
+    for (size_t i = 0; unchanged && i < quietInput.size(); ++i) {
+        unchanged = std::abs(quietOutput[i] - quietInput[i]) < 1e-12;
+    }
+    check(unchanged, "limiter leaves samples under the ceiling untouched");
+    check(quiet.limitedSamples == 0, "limiter counts no samples under the ceiling");
+
+    // A lone peak: the gain is untouched a full lookahead before it, already falling just before it
+    // and fully down when it arrives, so nothing comes out over the ceiling
+    const size_t peak = 100;
+    std::vector<double> loudInput(200, 0.5);
+    loudInput[peak] = 2.0;
+    LookaheadLimiter loud(lookahead, ceiling);
+    std::vector<double> loudOutput = runLimiter(loud, loudInput, filling);
+
+    check(loudOutput.size() == loudInput.size(), "limiter delay brings out every input sample around a peak");
+    if (loudOutput.size() == loudInput.size()) {
+        bool underCeiling = true;
+        for (double value : loudOutput) {
+            underCeiling = underCeiling && std::abs(value) <= ceiling + 1e-9;
+        }
+        check(underCeiling, "limiter output stays under the ceiling");
+        check(std::abs(loudOutput[peak - lookahead] - 0.5) < 1e-12, "limiter gain is untouched a lookahead before a peak");
+        check(loudOutput[peak - 1] < 0.5, "limiter gain ramps down ahead of a peak");
+        check(std::abs(loudOutput[peak] - ceiling) < 1e-9, "limiter gain is fully down when the peak arrives");
+    }
+    check(loud.limitedSamples == 1 && std::abs(loud.minimumGain - ceiling / 2.0) < 1e-12, "limiter reports the limited peak");
+}
+
+void testCheckpointRoundTrip() {
+    std::string path = temporaryPath("roundtrip.checkpoint");
+
+    RenderCheckpoint written;
+    written.rows = 4096;
+    written.cols = 3000;
+    written.planesHash = 0xF3A5C96E12345678ULL; // Above INT64_MAX, so a signed parse would lose it
+    written.sampleRate = 44100;
+    written.samplesPerRow = 4410;
+    written.minFrequency = 20.1; // Not exact in binary, so it needs all 17 digits to come back
+    written.maxFrequency = 20000.0 / 3.0;
+    written.nextRow = 1234;
+    written.framesWritten = 5441940;
+    written.audibleFrames = 5000001;
+
+    RenderCheckpoint read;
+    check(writeCheckpoint(path, written), "checkpoint is written");
+    check(readCheckpoint(path, read), "checkpoint is read back");
+    check(read.rows == written.rows && read.cols == written.cols && read.planesHash == written.planesHash,
+        "checkpoint keeps the image dimensions and plane hash");
+    check(read.sampleRate == written.sampleRate && read.samplesPerRow == written.samplesPerRow
+        && read.minFrequency == written.minFrequency && read.maxFrequency == written.maxFrequency,
+        "checkpoint keeps the synthesis settings exactly");
+    check(read.nextRow == written.nextRow && read.framesWritten == written.framesWritten && read.audibleFrames == written.audibleFrames,
+        "checkpoint keeps the render position");
+    check(!std::filesystem::exists(path + ".tmp"), "checkpoint leaves no temporary file behind");
+
+    // Anything that is not a whole checkpoint is refused rather than half read
+    {
+        std::ofstream file(path, std::ios::trunc);
+        file << "SoundCanvasCheckpoint1\n4096 3000\n";
+    }
+    check(!readCheckpoint(path, read), "truncated checkpoint is refused");
+
+    std::filesystem::remove(path);
+    check(!readCheckpoint(path, read), "missing checkpoint is refused");
+}
+
+std::vector<short> readWavSamples(const std::string& path) {
+    SF_INFO info = {};
+    SNDFILE* file = sf_open(path.c_str(), SFM_READ, &info);
+    if (!file) {
+        return {};
+    }
+    std::vector<short> samples(static_cast<size_t>(info.frames) * info.channels);
+    sf_readf_short(file, samples.data(), info.frames);
+    sf_close(file);
+    return samples;
+}
+
+// Renders a raw image through the tile file and compares it with the in-memory render of
+// preprocessFrame; the image is sized so neither axis is a whole number of tiles
+void checkOutOfCoreMatches(const cv::Mat& image, const std::string& extension) {
+    std::string inputPath = temporaryPath("transpose" + extension);
+    std::string outOfCorePath = temporaryPath("transpose-tiled.wav");
+    std::string referencePath = temporaryPath("transpose-reference.wav");
+
+    {
+        std::ofstream file(inputPath, std::ios::binary | std::ios::trunc);
+        if (extension == ".pgm") {
+            file << "P5\n" << image.cols << ' ' << image.rows << "\n255\n";
+        }
+        file.write(reinterpret_cast<const char*>(image.data), static_cast<std::streamsize>(image.total() * image.elemSize()));
+    }
+
+    // A one-byte budget forces the smallest tiles
+    DecodeOptions options;
+    options.rawSize = image.size();
+    BatchOptions batchOptions;
+    batchOptions.jobs = 2;
+    batchOptions.memoryBudget = 1;
+    check(generateOutOfCoreWav(outOfCorePath, inputPath, options, batchOptions), "out-of-core render of " + extension + " succeeds");
+
+    cv::Mat alphaChannel;
+    cv::Mat reference = preprocessFrame(image, alphaChannel, true);
+    check(generateWavFile(referencePath, reference, alphaChannel, false), "in-memory render of " + extension + " succeeds");
+
+    std::vector<short> tiled = readWavSamples(outOfCorePath);
+    std::vector<short> expected = readWavSamples(referencePath);
+    check(!expected.empty() && tiled == expected, "out-of-core render of " + extension + " matches preprocessFrame");
+
+    std::filesystem::remove(inputPath);
+    std::filesystem::remove(outOfCorePath);
+    std::filesystem::remove(referencePath);
+}
+
+// Deterministic pixels that vary along both axes, so a transposed or shifted tile shows up
+cv::Mat patternImage(int rows, int cols, int channels) {
+    cv::Mat image(rows, cols, CV_8UC(channels));
+    for (int row = 0; row < rows; ++row) {
+        uchar* pixels = image.ptr<uchar>(row);
+        for (int i = 0; i < cols * channels; ++i) {
+            pixels[i] = static_cast<uchar>((row * 131 + i * 71 + (row * i) % 17 * 13) & 0xFF);
+        }
+    }
+    return image;
+}
+
+void testTileTranspose() {
+    // Gray+alpha, with fully transparent pixels among the rest
+    cv::Mat grayAlpha = patternImage(100, 130, 2);
+    for (int row = 0; row < grayAlpha.rows; row += 7) {
+        grayAlpha.ptr<uchar>(row)[(row % grayAlpha.cols) * 2 + 1] = 0;
+    }
+    checkOutOfCoreMatches(grayAlpha, ".ga");
+
+    // Opaque gray, which renders without an alpha plane
+    checkOutOfCoreMatches(patternImage(90, 150, 1), ".pgm");
+}
+
+} // namespace
+
+int main() {
+    testLimiterLookahead();
+    testCheckpointRoundTrip();
+    testTileTranspose();
+
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed." << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed." << std::endl;
+    return 0;
+}